@@ -1,15 +1,37 @@
 // inputlag-tester.cpp - Version avec overlay temps réel optionnel
 // OVERLAY: Affichage en temps réel avec --overlay (désactivé par défaut)
 // OVERLAY-SIZE: Facteur de dimensionnement pour l'overlay
+// TRACE: Spans par phase du chemin critique exportés en Chrome trace JSON avec --trace
+// FLIGHT: Flight recorder des dernières tentatives de capture, dumpé sur anomalie
+// ROI: Régions nommées supplémentaires mesurées dans la même passe avec --roi
+// OUTPUT: Un moteur de capture par sortie (--output), chacun sur son thread
+// SWEEP: Matrice de test (--sweep) exécutée cellule par cellule, reprise possible
+// STORE: Historique local en colonnes, indexé par empreinte matérielle/pilote (--store, --history)
+// GATE: Comparaison à une référence (--baseline), code de sortie 2 en cas de régression
+// SYNTH: Source de capture synthétique (--synthetic) pour valider la chaîne sans écran
+// SERVE: Serveur de contrôle sur named pipe (--serve), commandes texte et événements JSON lines
+// METRICS: Endpoint HTTP Prometheus local (--metrics), lu sans verrou depuis les moteurs
+// DASHBOARD: Tableau de bord ANSI dans le terminal (--dashboard), thread basse priorité
+// RT: Threads de mesure épinglés (--pin), MMCSS/time-critical (--rt), mémoire verrouillée (--lock-memory)
+// STIMULUS: Séquences de stimuli (--stimulus) : move, clic, touche, position absolue, ROI par étape
+// DECOMP: Décomposition de la latence (curseur, première image composée, changement de la région)
+// SIM: Simulateur de pipeline de rendu (--simulate) : biais de l'estimateur sur horloge virtuelle
+// CLOCK: Cadencement de l'échantillonnage via une horloge injectable, virtuelle avec --virtual-clock
+// MODES: Densité des latences (KDE), modes en frames, runs multimodaux ou en dérive
+// BENCH: Benchmark des chemins chauds (--benchmark) : ns/pixel, sondages/s, allocations, JSON
 // 
-// Compile: cl /std:c++17 /W4 /O2 /EHsc inputlag-tester.cpp /link dxgi.lib d3d11.lib kernel32.lib user32.lib advapi32.lib gdi32.lib
+// Compile: cl /std:c++17 /W4 /O2 /EHsc inputlag-tester.cpp /link dxgi.lib d3d11.lib kernel32.lib user32.lib advapi32.lib gdi32.lib ws2_32.lib winmm.lib avrt.lib
 
+#include <winsock2.h>
 #include <windows.h>
 #include <dxgi.h>
 #include <dxgi1_2.h>
 #include <d3d11.h>
+#include <mmsystem.h>
+#include <avrt.h>
 #include <wrl/client.h>
 #include <vector>
+#include <map>
 #include <string>
 #include <cstring>
 #include <cstdio>
@@ -17,6 +39,16 @@
 #include <cmath>
 #include <algorithm>
 #include <chrono>
+#include <mutex>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <ctime>
+#include <thread>
+#include <future>
+#include <condition_variable>
+#include <random>
+#include <intrin.h>
 #include <winuser.h>
 
 #pragma comment(lib, "dxgi.lib")
@@ -25,6 +57,9 @@
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "advapi32.lib")
 #pragma comment(lib, "gdi32.lib")
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "winmm.lib")
+#pragma comment(lib, "avrt.lib")
 
 using Microsoft::WRL::ComPtr;
 using namespace std::chrono;
@@ -40,6 +75,14 @@ static double g_overlayLastLatency = 0.0;
 static double g_overlayFrameTimeMs = 0.0;
 static bool g_showOverlay = false;  // Désactivé par défaut
 static double g_overlaySizeFactor = 1.0;  // Facteur de dimensionnement (défaut: 1.0)
+static HBRUSH g_overlayBrush = nullptr;   // créés une fois avec la fenêtre, réutilisés à chaque WM_PAINT
+static HFONT g_overlayFont = nullptr;
+static ULONGLONG g_overlayLastInvalidateTick = 0;
+static const ULONGLONG kOverlayRefreshMs = 100;
+
+// Tableau de bord terminal (--dashboard)
+static bool g_showDashboard = false;
+static const int kDashboardRefreshMs = 250;
 
 // Infos système / run
 static std::string g_cpuName;
@@ -60,6 +103,79 @@ static std::string g_biosVersion;
 // Résultats + sortie fichier
 static std::vector<int64_t> g_results;
 static std::vector<std::vector<int64_t>> g_allResults;
+static std::vector<std::vector<double>> g_allFrameIntervalsMs;
+
+// Régions d'intérêt supplémentaires (--roi), hachées dans la même passe que la région principale
+struct CaptureRoi {
+    std::string name;
+    int x = 0, y = 0, w = 0, h = 0;
+};
+
+static const int kMaxExtraRois = 48;
+static const int kRegionCentered = -1;   // x ou y de la région principale : centré sur l'écran
+static const int kRoiGraceFrames = 3;   // attente des ROI après le changement de la région principale
+static std::vector<CaptureRoi> g_extraRois;
+static std::string g_stimulusSpec;   // --stimulus, résolu après lecture de toutes les --roi
+static std::vector<std::vector<std::vector<int64_t>>> g_roiResults;   // [roi][run][sample]
+static std::vector<int> g_roiUnchanged;
+
+// Sorties capturées (--output ADAPTER:OUTPUT) ; adapterIndex = -1 : adaptateur par défaut
+struct OutputSelection {
+    int adapterIndex = -1;
+    int outputIndex = 0;
+};
+
+static std::vector<OutputSelection> g_outputSelections;
+static bool g_listOutputs = false;
+
+// Cache de l'inventaire matériel (--refresh-inventory : ignoré et réécrit)
+static bool g_refreshInventory = false;
+
+// Ordonnancement des threads de mesure (--rt / --pin / --lock-memory)
+static bool g_realtime = false;
+static std::vector<int> g_pinCpus;   // [0] : thread d'input, puis threads de capture (tourniquet)
+static bool g_lockMemory = false;
+
+// Endpoint Prometheus (--metrics PORT) ; 0 = désactivé
+static int g_metricsPort = 0;
+static const DWORD kMetricsRecvTimeoutMs = 2000;   // client muet : on ferme au lieu de bloquer le thread
+
+// Serveur de contrôle (--serve) ; g_abortRequested interrompt la session en cours
+static std::string g_servePipeName;
+static std::atomic<bool> g_abortRequested{false};
+
+// Mode sweep (--sweep)
+static std::string g_sweepFilePath;
+static int g_sweepWaitSeconds = -1;   // -1 : attendre ENTRÉE entre les cellules
+
+// Simulateur de pipeline de rendu (--simulate)
+static std::string g_simulateFilePath;
+
+// Benchmark des chemins chauds (--benchmark), résultats JSON
+static std::string g_benchmarkFilePath;
+
+// Historique local des sessions (--store / --tag / --history) ; désactivé sans --store DIR
+static std::string g_storeDir;
+static std::string g_storeTag;
+static bool g_showHistory = false;
+
+// Source de capture synthétique (--synthetic LAT[,JITTER[,HZ[,SEED]]])
+struct SyntheticCaptureConfig {
+    bool enabled = false;
+    double latencyMs = 12.0;
+    double jitterMs = 2.0;
+    int refreshHz = 144;
+    uint32_t seed = 0;   // 0 : graine dérivée de l'heure
+};
+
+static SyntheticCaptureConfig g_synthetic;
+
+// Porte de régression (--baseline / --save-baseline)
+static std::string g_baselinePath;
+static std::string g_saveBaselinePath;
+static double g_gateAlpha = 0.01;
+static double g_gateToleranceMs = 0.5;
+static double g_gateTolerancePct = 5.0;
 static std::string g_outputFilePath;
 
 // Configuration multi-run
@@ -83,6 +199,697 @@ struct DiagnosticStats {
 
 static DiagnosticStats g_diagStats;
 
+void AccumulateDiagnosticStats(DiagnosticStats& total, const DiagnosticStats& part) {
+    total.totalAttempts += part.totalAttempts;
+    total.successfulCaptures += part.successfulCaptures;
+    total.timeouts += part.timeouts;
+    total.sameChecksum += part.sameChecksum;
+    total.mouseUpdatesOnly += part.mouseUpdatesOnly;
+    total.acquireErrors += part.acquireErrors;
+    total.checksumChanges += part.checksumChanges;
+    total.exclusiveScreenDetected += part.exclusiveScreenDetected;
+}
+
+// -------- Instrumentation des phases (--trace) --------
+// Chaque phase du chemin critique est enregistrée dans un anneau préalloué par thread
+// (horodatage ns), puis exportée en JSON Chrome trace-event (Perfetto / chrome://tracing).
+// Compiler avec /DINPUTLAG_TRACE=0 retire complètement les sondes.
+#ifndef INPUTLAG_TRACE
+#define INPUTLAG_TRACE 1
+#endif
+
+enum TracePhase : uint8_t {
+    PHASE_INPUT_SEND = 0,
+    PHASE_ACQUIRE_WAIT,
+    PHASE_COPY,
+    PHASE_MAP,
+    PHASE_HASH,
+    PHASE_RELEASE,
+    PHASE_MATCH,
+    PHASE_REPORT,
+    PHASE_COUNT
+};
+
+static const char* kTracePhaseNames[PHASE_COUNT] = {
+    "input_send", "acquire_wait", "copy", "map", "hash", "unmap_release", "match", "report"
+};
+
+struct TraceEvent {
+    int64_t startNs;
+    uint32_t durationNs;
+    uint8_t phase;
+};
+
+// Histogramme log-linéaire : 4 sous-intervalles par puissance de 2 (erreur relative < 19%)
+static const int kTraceHistBuckets = 4 * 48;
+
+struct TracePhaseHistogram {
+    uint64_t buckets[kTraceHistBuckets] = {};
+    uint64_t count = 0;
+    uint64_t sumNs = 0;
+    uint64_t maxNs = 0;
+};
+
+static const size_t kTraceRingCapacity = 1 << 18;
+
+struct TraceRing {
+    std::vector<TraceEvent> events;
+    uint64_t written = 0;
+    uint32_t threadId = 0;
+    std::string threadName;
+    TracePhaseHistogram histograms[PHASE_COUNT];
+};
+
+static bool g_traceEnabled = false;
+static std::string g_traceFilePath;
+static int64_t g_traceOriginNs = 0;
+static std::mutex g_traceRingsMutex;
+static std::vector<std::unique_ptr<TraceRing>> g_traceRings;
+static thread_local TraceRing* t_traceRing = nullptr;
+
+static inline int64_t TraceNowNs() {
+    return duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
+}
+
+static inline int TraceBucketIndex(uint64_t ns) {
+    if (ns < 4) return static_cast<int>(ns);
+    int msb = 63;
+    while (!(ns >> msb)) msb--;
+    int sub = static_cast<int>((ns >> (msb - 2)) & 3);
+    int idx = 4 * (msb - 1) + sub;
+    return idx < kTraceHistBuckets ? idx : kTraceHistBuckets - 1;
+}
+
+static inline uint64_t TraceBucketMidNs(int idx) {
+    if (idx < 4) return static_cast<uint64_t>(idx);
+    int msb = idx / 4 + 1;
+    uint64_t lo = (4ull + (idx % 4)) << (msb - 2);
+    uint64_t width = 1ull << (msb - 2);
+    return lo + width / 2;
+}
+
+static inline void HistogramAdd(TracePhaseHistogram& h, uint64_t ns) {
+    h.buckets[TraceBucketIndex(ns)]++;
+    h.count++;
+    h.sumNs += ns;
+    if (ns > h.maxNs) h.maxNs = ns;
+}
+
+static uint64_t HistogramPercentileNs(const TracePhaseHistogram& h, int percent) {
+    uint64_t target = (h.count * percent + 99) / 100;
+    uint64_t cumulative = 0;
+    for (int b = 0; b < kTraceHistBuckets; b++) {
+        cumulative += h.buckets[b];
+        if (cumulative >= target) return TraceBucketMidNs(b);
+    }
+    return h.maxNs;
+}
+
+// Alloue l'anneau du thread courant ; à appeler au démarrage du thread, hors de la boucle de
+// mesure (les phases d'un thread non enregistré ne sont pas tracées)
+TraceRing* TraceRegisterCurrentThread(const char* name) {
+    if (t_traceRing) return t_traceRing;
+    auto ring = std::make_unique<TraceRing>();
+    ring->events.resize(kTraceRingCapacity);
+    ring->threadId = GetCurrentThreadId();
+    ring->threadName = name;
+    t_traceRing = ring.get();
+    std::lock_guard<std::mutex> lock(g_traceRingsMutex);
+    g_traceRings.push_back(std::move(ring));
+    return t_traceRing;
+}
+
+static inline void TraceRecord(TracePhase phase, int64_t startNs, int64_t endNs) {
+    TraceRing* ring = t_traceRing;
+    if (!ring) return;
+    uint64_t durNs = endNs > startNs ? static_cast<uint64_t>(endNs - startNs) : 0;
+
+    TraceEvent& ev = ring->events[ring->written & (kTraceRingCapacity - 1)];
+    ev.startNs = startNs;
+    ev.durationNs = durNs > 0xFFFFFFFFull ? 0xFFFFFFFFu : static_cast<uint32_t>(durNs);
+    ev.phase = phase;
+    ring->written++;
+
+    HistogramAdd(ring->histograms[phase], durNs);
+}
+
+class TraceScope {
+public:
+    explicit TraceScope(TracePhase phase)
+        : phase_(phase), startNs_(g_traceEnabled ? TraceNowNs() : 0) {}
+    ~TraceScope() {
+        if (startNs_) TraceRecord(phase_, startNs_, TraceNowNs());
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+private:
+    TracePhase phase_;
+    int64_t startNs_;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#if INPUTLAG_TRACE
+#define TRACE_SCOPE(phase) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(phase)
+#else
+#define TRACE_SCOPE(phase) ((void)0)
+#endif
+
+// Export JSON Chrome trace-event (événements complets "X", timestamps en µs)
+bool WriteChromeTrace(const std::string& path) {
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "w") != 0 || !f) {
+        printf("[TRACE] ERROR Could not open %s for writing\n", path.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_traceRingsMutex);
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    size_t exported = 0;
+    for (const auto& ring : g_traceRings) {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", (unsigned long)GetCurrentProcessId(), ring->threadId, ring->threadName.c_str());
+        first = false;
+
+        uint64_t count = ring->written < kTraceRingCapacity ? ring->written : kTraceRingCapacity;
+        uint64_t begin = ring->written - count;
+        for (uint64_t i = begin; i < ring->written; i++) {
+            const TraceEvent& ev = ring->events[i & (kTraceRingCapacity - 1)];
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"capture\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%u}",
+                    kTracePhaseNames[ev.phase],
+                    (ev.startNs - g_traceOriginNs) / 1000.0,
+                    ev.durationNs / 1000.0,
+                    (unsigned long)GetCurrentProcessId(), ring->threadId);
+            exported++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    printf("[TRACE] %zu events written to: %s\n", exported, path.c_str());
+    return true;
+}
+
+// Histogrammes de latence par phase (tous threads confondus)
+void PrintTraceReport() {
+    if (!g_traceEnabled) return;
+
+    TracePhaseHistogram merged[PHASE_COUNT];
+    {
+        std::lock_guard<std::mutex> lock(g_traceRingsMutex);
+        for (const auto& ring : g_traceRings) {
+            for (int p = 0; p < PHASE_COUNT; p++) {
+                const TracePhaseHistogram& src = ring->histograms[p];
+                for (int b = 0; b < kTraceHistBuckets; b++) merged[p].buckets[b] += src.buckets[b];
+                merged[p].count += src.count;
+                merged[p].sumNs += src.sumNs;
+                if (src.maxNs > merged[p].maxNs) merged[p].maxNs = src.maxNs;
+            }
+        }
+    }
+
+    printf("\n");
+    printf("==========================================\n");
+    printf(" HOT-PATH PHASE TIMINGS (microseconds)\n");
+    printf("==========================================\n");
+    printf(" %-14s %9s %9s %9s %9s %9s\n", "Phase", "Count", "Avg", "P50", "P99", "Max");
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        const TracePhaseHistogram& h = merged[p];
+        if (h.count == 0) {
+            printf(" %-14s %9d %9s %9s %9s %9s\n", kTracePhaseNames[p], 0, "-", "-", "-", "-");
+            continue;
+        }
+
+        uint64_t p50Ns = HistogramPercentileNs(h, 50);
+        uint64_t p99Ns = HistogramPercentileNs(h, 99);
+
+        printf(" %-14s %9llu %9.1f %9.1f %9.1f %9.1f\n", kTracePhaseNames[p],
+               (unsigned long long)h.count,
+               (h.sumNs / (double)h.count) / 1000.0,
+               p50Ns / 1000.0, p99Ns / 1000.0, h.maxNs / 1000.0);
+    }
+
+    // Distribution grossière par phase (puissances de 10 en µs)
+    static const double kEdgesUs[] = {1, 10, 100, 1000, 10000};
+    static const char* kEdgeLabels[] = {"<1us", "<10us", "<100us", "<1ms", "<10ms", ">=10ms"};
+    printf("\n %-14s", "Histogram");
+    for (const char* label : kEdgeLabels) printf(" %7s", label);
+    printf("\n");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        const TracePhaseHistogram& h = merged[p];
+        if (h.count == 0) continue;
+        uint64_t bins[6] = {};
+        for (int b = 0; b < kTraceHistBuckets; b++) {
+            if (!h.buckets[b]) continue;
+            double us = TraceBucketMidNs(b) / 1000.0;
+            int bin = 0;
+            while (bin < 5 && us >= kEdgesUs[bin]) bin++;
+            bins[bin] += h.buckets[b];
+        }
+        printf(" %-14s", kTracePhaseNames[p]);
+        for (uint64_t c : bins) printf(" %6.1f%%", 100.0 * c / h.count);
+        printf("\n");
+    }
+    printf("\n");
+}
+
+// -------- Flight recorder (toujours actif) --------
+// Anneau sans verrou des dernières tentatives de capture ; un dump compact est écrit
+// automatiquement sur timeout d'échantillon, erreur d'acquisition ou latence aberrante.
+struct FlightRecord {
+    int64_t timestampNs;
+    int64_t sinceInputNs;
+    int32_t hr;
+    int32_t acquireTimeUs;
+    uint32_t accumulatedFrames;
+    uint32_t checksum;
+    int32_t sample;
+    uint16_t run;
+    uint16_t changedTiles;
+    uint8_t mouseOnly;
+    uint8_t engine;
+};
+
+struct FlightSlot {
+    std::atomic<uint64_t> seq{0};   // 2*idx+1 pendant l'écriture, 2*idx+2 une fois publié
+    FlightRecord record;
+};
+
+static const size_t kFlightCapacity = 4096;
+static FlightSlot g_flightSlots[kFlightCapacity];
+static std::atomic<uint64_t> g_flightHead{0};
+
+static std::string g_flightDir;
+static double g_flightOutlierMs = 0.0;   // 0 = auto (3x la médiane courante)
+static int g_flightMaxDumps = 10;
+static int g_flightDepth = 256;
+static std::atomic<int> g_flightDumpsWritten{0};   // session en cours (limite --flight-max-dumps)
+static std::atomic<int> g_flightDumpsTotal{0};     // tout le processus (bilan final)
+
+static inline void FlightRecorderRecord(const FlightRecord& rec) {
+    uint64_t idx = g_flightHead.fetch_add(1, std::memory_order_relaxed);
+    FlightSlot& slot = g_flightSlots[idx & (kFlightCapacity - 1)];
+    slot.seq.store(2 * idx + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = rec;
+    slot.seq.store(2 * idx + 2, std::memory_order_release);
+}
+
+// Copie cohérente des `maxCount` derniers enregistrements publiés (du plus ancien au plus récent)
+size_t FlightRecorderSnapshot(std::vector<FlightRecord>& out, size_t maxCount) {
+    out.clear();
+    uint64_t head = g_flightHead.load(std::memory_order_acquire);
+    if (maxCount > kFlightCapacity) maxCount = kFlightCapacity;
+    uint64_t count = head < maxCount ? head : maxCount;
+    out.reserve(static_cast<size_t>(count));
+    for (uint64_t idx = head - count; idx < head; idx++) {
+        const FlightSlot& slot = g_flightSlots[idx & (kFlightCapacity - 1)];
+        uint64_t before = slot.seq.load(std::memory_order_acquire);
+        FlightRecord rec = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = slot.seq.load(std::memory_order_relaxed);
+        if (before == after && before == 2 * idx + 2) {
+            out.push_back(rec);
+        }
+    }
+    return out.size();
+}
+
+void FlightRecorderDump(const char* reason, int output, int run, int sample, const char* detail) {
+    if (g_flightDumpsWritten.fetch_add(1) >= g_flightMaxDumps) {
+        g_flightDumpsWritten--;
+        return;
+    }
+
+    std::vector<FlightRecord> records;
+    if (FlightRecorderSnapshot(records, static_cast<size_t>(g_flightDepth)) == 0) {
+        g_flightDumpsWritten--;
+        return;
+    }
+
+    time_t now = time(nullptr);
+    struct tm local = {};
+    localtime_s(&local, &now);
+    char fileName[128] = {};
+    sprintf_s(fileName, sizeof(fileName), "flightrec_%04d%02d%02d-%02d%02d%02d_out%d_run%d_s%d_%s.txt",
+              local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+              local.tm_hour, local.tm_min, local.tm_sec, output, run, sample, reason);
+
+    std::string path = g_flightDir;
+    if (!path.empty() && path.back() != '\\' && path.back() != '/') path += '\\';
+    path += fileName;
+
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "w") != 0 || !f) {
+        printf("[FLIGHT] ERROR Could not write dump %s\n", path.c_str());
+        g_flightDumpsWritten--;
+        return;
+    }
+
+    fprintf(f, "# inputlag-tester flight recorder dump\n");
+    fprintf(f, "# reason=%s run=%d sample=%d %s\n", reason, run, sample, detail ? detail : "");
+    fprintf(f, "# columns: t_ms since_input_ms engine run sample hr acquire_us frames mouse_only checksum tiles\n");
+    int64_t originNs = records.front().timestampNs;
+    for (const FlightRecord& r : records) {
+        fprintf(f, "%.3f %.3f %u %u %d 0x%08X %d %u %u %08X %04X\n",
+                (r.timestampNs - originNs) / 1000000.0,
+                r.sinceInputNs / 1000000.0,
+                r.engine, r.run, r.sample, static_cast<unsigned>(r.hr), r.acquireTimeUs,
+                r.accumulatedFrames, r.mouseOnly, r.checksum, r.changedTiles);
+    }
+    fclose(f);
+    g_flightDumpsTotal++;
+
+    printf("[FLIGHT] Dump written (%s, %zu attempts): %s\n", reason, records.size(), path.c_str());
+}
+
+// Seuil de latence aberrante (ns) ; 0 tant que la médiane automatique n'est pas fiable.
+// scratch est réservé par l'appelant : pas d'allocation sur le chemin de mesure
+int64_t FlightOutlierThresholdNs(const std::vector<int64_t>& runResults, std::vector<int64_t>& scratch) {
+    if (g_flightOutlierMs > 0.0) {
+        return static_cast<int64_t>(g_flightOutlierMs * 1000000.0);
+    }
+    if (runResults.size() < 20) return 0;
+    scratch.assign(runResults.begin(), runResults.end());
+    std::nth_element(scratch.begin(), scratch.begin() + scratch.size() / 2, scratch.end());
+    return 3 * scratch[scratch.size() / 2];
+}
+
+// -------- Horloge des boucles de mesure --------
+// Tout le cadencement de l'échantillonnage (intervalle entre inputs, délai de départ, pauses,
+// sondage des moteurs, source synthétique) passe par une Clock. RealClock : high_resolution_clock
+// et Sleep(). VirtualClock : temps simulé qui avance instantanément ; Sleep(ms) se réveille au
+// premier tick du timer simulé qui suit l'échéance, comme le timer système de Windows. Une
+// VirtualClock n'est avancée que par un seul thread (session en ligne, ou simulateur).
+class Clock {
+public:
+    virtual ~Clock() {}
+    virtual int64_t nowNs() = 0;
+    virtual void sleepMs(DWORD ms) = 0;
+    virtual void sleepUntilNs(int64_t targetNs) = 0;
+    virtual bool realTime() const = 0;
+};
+
+class RealClock : public Clock {
+public:
+    int64_t nowNs() override { return TraceNowNs(); }
+    void sleepMs(DWORD ms) override { Sleep(ms); }
+
+    // Sleep() grossier puis attente active sur la dernière milliseconde
+    void sleepUntilNs(int64_t targetNs) override {
+        for (;;) {
+            int64_t remainingNs = targetNs - nowNs();
+            if (remainingNs <= 0) return;
+            if (remainingNs > 2000000) Sleep(static_cast<DWORD>(remainingNs / 1000000 - 1));
+            else std::this_thread::yield();
+        }
+    }
+
+    bool realTime() const override { return true; }
+};
+
+class VirtualClock : public Clock {
+public:
+    explicit VirtualClock(int64_t timerGranularityNs)
+        : granularityNs_(timerGranularityNs > 0 ? timerGranularityNs : 1) {}
+
+    int64_t nowNs() override { return nowNs_; }
+
+    void sleepMs(DWORD ms) override {
+        int64_t wakeNs = nowNs_ + static_cast<int64_t>(ms) * 1000000;
+        advanceTo((wakeNs + granularityNs_ - 1) / granularityNs_ * granularityNs_);
+    }
+
+    void sleepUntilNs(int64_t targetNs) override { advanceTo(targetNs); }
+    bool realTime() const override { return false; }
+
+    void advance(int64_t ns) { nowNs_ += ns; }
+    void advanceTo(int64_t ns) { if (ns > nowNs_) nowNs_ = ns; }
+
+private:
+    int64_t nowNs_ = 1000000000;   // 0 signifie "aucun horodatage" dans CaptureFrameInfo
+    int64_t granularityNs_;
+};
+
+static RealClock g_realClock;
+static VirtualClock g_virtualClock(1000000);
+static Clock* g_clock = &g_realClock;   // --virtual-clock : g_virtualClock
+
+// -------- Ordonnancement des threads de mesure (--rt / --pin / --lock-memory) --------
+// Le thread d'input et les threads de capture peuvent être épinglés sur des cœurs choisis,
+// passés en MMCSS "Pro Audio" (à défaut THREAD_PRIORITY_TIME_CRITICAL) et voir leur pile et
+// leurs tampons verrouillés en mémoire. Chaque échec est signalé puis ignoré : la mesure
+// continue avec l'ordonnancement par défaut. Le retard de réveil des Sleep() des boucles de
+// mesure est toujours enregistré, pour rendre l'effet de ces réglages visible dans le rapport.
+static const SIZE_T kLockedWorkingSetMin = 256ull << 20;
+static const SIZE_T kLockedWorkingSetMax = 1024ull << 20;
+static const size_t kStackPrefaultBytes = 64 * 1024;
+static bool g_timerPeriodRaised = false;
+static size_t g_lockedProcessBytes = 0;
+
+struct ThreadScheduling {
+    std::string name;
+    int cpu = -1;                    // -1 : non épinglé
+    const char* priority = "normal";
+    size_t lockedBytes = 0;
+    HANDLE mmcssTask = nullptr;
+    TracePhaseHistogram wakeup;      // retard au-delà de la durée demandée
+};
+
+static ThreadScheduling g_inputScheduling;
+
+// Sleep() dont le retard de réveil est enregistré dans l'histogramme du thread
+static inline void SleepMeasured(DWORD ms, ThreadScheduling& sched, Clock& clock = *g_clock) {
+    int64_t startNs = clock.nowNs();
+    clock.sleepMs(ms);
+    int64_t lateNs = clock.nowNs() - startNs - static_cast<int64_t>(ms) * 1000000;
+    HistogramAdd(sched.wakeup, lateNs > 0 ? static_cast<uint64_t>(lateNs) : 0);
+}
+
+// Retourne le nombre d'octets verrouillés (0 si --lock-memory est inactif ou en échec)
+size_t LockHotBuffer(const void* data, size_t bytes) {
+    if (!g_lockMemory || !data || bytes == 0) return 0;
+    return VirtualLock(const_cast<void*>(data), bytes) ? bytes : 0;
+}
+
+// "2,4-5" -> {2, 4, 5}
+bool ParseCpuList(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t comma = text.find(',', pos);
+        std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        int first = -1, last = -1;
+        int fields = sscanf_s(item.c_str(), "%d-%d", &first, &last);
+        if (fields < 1) return false;
+        if (fields == 1) last = first;
+        if (first < 0 || last < first || last >= 64) return false;
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        if (comma == std::string::npos) break;
+        pos = comma + 1;
+    }
+    return !cpus.empty();
+}
+
+// Réglages du processus, avant le démarrage des moteurs
+void ApplyProcessScheduling() {
+    if (!g_pinCpus.empty()) {
+        DWORD_PTR processMask = 0, systemMask = 0;
+        GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+        std::vector<int> usable;
+        for (int cpu : g_pinCpus) {
+            if (processMask & (DWORD_PTR(1) << cpu)) usable.push_back(cpu);
+            else printf("[RT] WARNING CPU %d is not available to this process, ignored\n", cpu);
+        }
+        g_pinCpus = usable;
+        if (g_pinCpus.empty()) printf("[RT] WARNING no usable CPU left, threads are not pinned\n");
+    }
+
+    if (g_realtime) {
+        if (!SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS)) {
+            printf("[RT] WARNING could not raise the process priority class (error %lu)\n", GetLastError());
+        }
+        g_timerPeriodRaised = timeBeginPeriod(1) == TIMERR_NOERROR;
+        if (!g_timerPeriodRaised) printf("[RT] WARNING could not set a 1 ms timer resolution\n");
+    }
+
+    if (g_lockMemory) {
+        if (!SetProcessWorkingSetSize(GetCurrentProcess(), kLockedWorkingSetMin, kLockedWorkingSetMax)) {
+            printf("[RT] WARNING could not raise the working set (error %lu), memory stays pageable\n", GetLastError());
+            g_lockMemory = false;
+        } else {
+            g_lockedProcessBytes += LockHotBuffer(g_flightSlots, sizeof(g_flightSlots));
+        }
+    }
+}
+
+void RestoreProcessScheduling() {
+    if (g_timerPeriodRaised) {
+        timeEndPeriod(1);
+        g_timerPeriodRaised = false;
+    }
+}
+
+// Prépare le thread appelant ; slot 0 = input, 1 + i = moteur de capture i
+void ApplyThreadScheduling(ThreadScheduling& sched, const char* name, int slot) {
+    sched.name = name;
+    if (!g_pinCpus.empty()) {
+        int cpu = g_pinCpus[slot % g_pinCpus.size()];
+        if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu)) {
+            sched.cpu = cpu;
+        } else {
+            printf("[RT] WARNING %s: could not pin to CPU %d (error %lu)\n", name, cpu, GetLastError());
+        }
+    }
+
+    if (g_realtime) {
+        DWORD taskIndex = 0;
+        sched.mmcssTask = AvSetMmThreadCharacteristicsA("Pro Audio", &taskIndex);
+        if (sched.mmcssTask) {
+            AvSetMmThreadPriority(sched.mmcssTask, AVRT_PRIORITY_CRITICAL);
+            sched.priority = "MMCSS Pro Audio";
+        } else if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+            sched.priority = "time-critical";
+        } else {
+            printf("[RT] WARNING %s: could not raise the thread priority (error %lu)\n", name, GetLastError());
+        }
+    }
+
+    if (g_lockMemory) {
+        // Pré-charge puis verrouille la pile sous ce point : les appels plus profonds ne fautent plus
+        char stackPrefault[kStackPrefaultBytes];
+        SecureZeroMemory(stackPrefault, sizeof(stackPrefault));
+        sched.lockedBytes += LockHotBuffer(stackPrefault, sizeof(stackPrefault));
+    }
+}
+
+void RevertThreadScheduling(ThreadScheduling& sched) {
+    if (sched.mmcssTask) {
+        AvRevertMmThreadCharacteristics(sched.mmcssTask);
+        sched.mmcssTask = nullptr;
+    }
+}
+
+// -------- Analyse du frame pacing --------
+// Construite à partir des LastPresentTime déjà renvoyés par AcquireNextFrame : aucune
+// capture supplémentaire. Quand plusieurs présentations sont coalescées entre deux
+// acquisitions, l'intervalle est réparti uniformément sur AccumulatedFrames.
+static double g_stutterFactor = 2.0;
+static const double kPacingIdleGapMs = 250.0;   // au-delà : bureau statique, pas un stutter
+static const UINT kPacingMaxCoalesced = 64;
+static size_t g_pacingCoalescedFrames = 0;
+
+class FramePacingAnalyzer {
+public:
+    void reset(size_t expectedFrames) {
+        intervalsMs_.clear();
+        intervalsMs_.reserve(expectedFrames);
+        lastPresentQpc_ = 0;
+        coalescedFrames_ = 0;
+        if (qpcFrequency_ == 0) {
+            LARGE_INTEGER freq;
+            QueryPerformanceFrequency(&freq);
+            qpcFrequency_ = freq.QuadPart;
+        }
+    }
+
+    void onFrame(int64_t presentQpc, UINT accumulatedFrames) {
+        if (presentQpc == 0 || accumulatedFrames == 0) return;
+        if (lastPresentQpc_ != 0 && presentQpc > lastPresentQpc_) {
+            double spanMs = (presentQpc - lastPresentQpc_) * 1000.0 / static_cast<double>(qpcFrequency_);
+            double perFrameMs = spanMs / accumulatedFrames;
+            // Au-delà de kPacingMaxCoalesced images, l'intervalle est ignoré plutôt que tronqué
+            if (perFrameMs < kPacingIdleGapMs && accumulatedFrames <= kPacingMaxCoalesced) {
+                for (UINT i = 0; i < accumulatedFrames; i++) intervalsMs_.push_back(perFrameMs);
+                if (accumulatedFrames > 1) coalescedFrames_ += accumulatedFrames;
+            }
+        }
+        lastPresentQpc_ = presentQpc;
+    }
+
+    const std::vector<double>& intervalsMs() const { return intervalsMs_; }
+    size_t coalescedFrames() const { return coalescedFrames_; }
+
+private:
+    std::vector<double> intervalsMs_;
+    int64_t lastPresentQpc_ = 0;
+    int64_t qpcFrequency_ = 0;
+    size_t coalescedFrames_ = 0;
+};
+
+// Quantile q d'une série triée non vide : rang n*q, borné au dernier échantillon
+template <typename T>
+T SortedPercentile(const std::vector<T>& sorted, double q) {
+    size_t idx = static_cast<size_t>(sorted.size() * q);
+    return idx < sorted.size() ? sorted[idx] : sorted.back();
+}
+
+struct FramePacingStats {
+    size_t frames = 0;
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+    double avgFps = 0.0;
+    double onePercentLowFps = 0.0;
+    int stutters = 0;
+};
+
+FramePacingStats ComputeFramePacingStats(std::vector<double> intervalsMs) {
+    FramePacingStats st;
+    if (intervalsMs.empty()) return st;
+
+    std::sort(intervalsMs.begin(), intervalsMs.end());
+    size_t n = intervalsMs.size();
+    st.frames = n;
+    st.p50Ms = intervalsMs[n / 2];
+    st.p99Ms = SortedPercentile(intervalsMs, 0.99);
+
+    double sum = 0.0;
+    for (double v : intervalsMs) sum += v;
+    st.avgFps = sum > 0.0 ? 1000.0 * n / sum : 0.0;
+
+    // 1% low : FPS moyen sur le pire centile des frame times
+    size_t worst = n / 100 > 0 ? n / 100 : 1;
+    double worstSum = 0.0;
+    for (size_t i = n - worst; i < n; i++) worstSum += intervalsMs[i];
+    st.onePercentLowFps = worstSum > 0.0 ? 1000.0 * worst / worstSum : 0.0;
+
+    double stutterMs = st.p50Ms * g_stutterFactor;
+    for (double v : intervalsMs) {
+        if (v > stutterMs) st.stutters++;
+    }
+    return st;
+}
+
+void PrintFramePacingResults() {
+    std::vector<double> all;
+    for (const auto& run : g_allFrameIntervalsMs) all.insert(all.end(), run.begin(), run.end());
+
+    printf("[*] Frame Pacing (from DXGI present times)\n");
+    if (all.size() < 2) {
+        printf("    Not enough presented frames observed\n\n");
+        return;
+    }
+
+    FramePacingStats st = ComputeFramePacingStats(all);
+    printf("    Frames    : %zu\n", st.frames);
+    printf("    Avg FPS   : %.1f\n", st.avgFps);
+    printf("    1%% Low   : %.1f FPS\n", st.onePercentLowFps);
+    printf("    Frame P50 : %.2f ms\n", st.p50Ms);
+    printf("    Frame P99 : %.2f ms\n", st.p99Ms);
+    printf("    Stutters  : %d (> %.1fx median frame time)\n", st.stutters, g_stutterFactor);
+    printf("    Coalesced : %.1f%% of frames (interval averaged across AccumulatedFrames)\n",
+           100.0 * g_pacingCoalescedFrames / st.frames);
+    for (size_t runIdx = 0; runIdx < g_allFrameIntervalsMs.size(); runIdx++) {
+        FramePacingStats rs = ComputeFramePacingStats(g_allFrameIntervalsMs[runIdx]);
+        if (rs.frames == 0) continue;
+        printf("    Run %zu: FPS=%.1f, 1%%Low=%.1f, P50=%.2f, P99=%.2f ms, Stutters=%d\n",
+               runIdx + 1, rs.avgFps, rs.onePercentLowFps, rs.p50Ms, rs.p99Ms, rs.stutters);
+    }
+    printf("\n");
+}
+
 // -------- Overlay Window Procedure --------
 LRESULT CALLBACK OverlayWindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
@@ -93,20 +900,13 @@ LRESULT CALLBACK OverlayWindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lP
             // Fond noir semi-transparent
             RECT rect;
             GetClientRect(hwnd, &rect);
-            HBRUSH hbrush = CreateSolidBrush(RGB(0, 0, 0));
-            FillRect(hdc, &rect, hbrush);
-            DeleteObject(hbrush);
+            FillRect(hdc, &rect, g_overlayBrush);
 
             // Texte blanc
             SetTextColor(hdc, RGB(255, 255, 255));
             SetBkMode(hdc, TRANSPARENT);
 
-            // Police monospace - dimensionnée selon le facteur
-            int fontSize = static_cast<int>(14.0 * g_overlaySizeFactor);
-            HFONT hfont = CreateFontA(fontSize, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
-                                     DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
-                                     DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, "Courier New");
-            HFONT oldFont = (HFONT)SelectObject(hdc, hfont);
+            HFONT oldFont = (HFONT)SelectObject(hdc, g_overlayFont);
 
             int x = static_cast<int>(10.0 * g_overlaySizeFactor);
             int y = static_cast<int>(5.0 * g_overlaySizeFactor);
@@ -142,7 +942,6 @@ LRESULT CALLBACK OverlayWindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lP
             }
 
             SelectObject(hdc, oldFont);
-            DeleteObject(hfont);
             EndPaint(hwnd, &ps);
             break;
         }
@@ -167,6 +966,13 @@ void CreateOverlayWindow() {
     wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
     RegisterClassA(&wc);
 
+    // Fond noir et police monospace dimensionnée selon le facteur
+    g_overlayBrush = CreateSolidBrush(RGB(0, 0, 0));
+    int fontSize = static_cast<int>(14.0 * g_overlaySizeFactor);
+    g_overlayFont = CreateFontA(fontSize, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
+                                DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+                                DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, "Courier New");
+
     // Créer la fenêtre en haut-droite avec dimensionnement selon le facteur
     int screenWidth = GetSystemMetrics(SM_CXSCREEN);
 
@@ -192,11 +998,29 @@ void CreateOverlayWindow() {
     }
 }
 
-// Mettre à jour l'overlay
+// Mettre à jour l'overlay : invalidation limitée à kOverlayRefreshMs, le WM_PAINT est
+// traité par ProcessWindowMessages() au lieu d'être forcé de façon synchrone
 void UpdateOverlay() {
     if (g_overlayWindow && IsWindow(g_overlayWindow)) {
+        ULONGLONG now = GetTickCount64();
+        if (now - g_overlayLastInvalidateTick < kOverlayRefreshMs) return;
+        g_overlayLastInvalidateTick = now;
         InvalidateRect(g_overlayWindow, nullptr, FALSE);
-        UpdateWindow(g_overlayWindow);
+    }
+}
+
+void DestroyOverlayWindow() {
+    if (g_overlayWindow) {
+        DestroyWindow(g_overlayWindow);
+        g_overlayWindow = nullptr;
+    }
+    if (g_overlayFont) {
+        DeleteObject(g_overlayFont);
+        g_overlayFont = nullptr;
+    }
+    if (g_overlayBrush) {
+        DeleteObject(g_overlayBrush);
+        g_overlayBrush = nullptr;
     }
 }
 
@@ -212,7 +1036,7 @@ void ProcessWindowMessages() {
 // Forward declarations
 std::string GetCpuLogicalCoresString();
 std::string GetOsVersionString();
-std::string GetGpuDriverVersion();
+std::string GetGpuDriverVersion(int adapterIndex);
 
 // -------- Fonction d'analyse des arguments --------
 void PrintUsage(const char* programName) {
@@ -228,17 +1052,60 @@ void PrintUsage(const char* programName) {
     printf(" -interval NUM  Interval between tests in ms (default: 50)\n");
     printf(" -dx NUM        Mouse movement distance (default: 30)\n");
     printf(" -o FILE        Output file path (default: none)\n");
+    printf(" --roi NAME:X,Y,W,H     Additional named region measured in the same pass (repeatable)\n");
+    printf(" --stimulus SEQ  Stimuli sent in turn: move[:DX] click[:left|right|middle] key:NAME abs:X,Y\n");
+    printf("                 separated by ';', '@ROI' measures a step on that --roi (default: move)\n");
+    printf(" --output A:O   Capture output O of adapter A; repeat to test outputs concurrently\n");
+    printf(" --list-outputs List adapters/outputs with their active refresh rate and exit\n");
+    printf(" --store DIR    Append sessions to the results history in DIR (default: no history)\n");
+    printf(" --no-store     Do not append this session to the results history\n");
+    printf(" --tag TAG      Label stored with the session (e.g. game build, settings)\n");
+    printf(" --history      Print stored P50/P95/P99 history for this GPU across drivers and exit\n");
+    printf(" --baseline FILE        Compare this session to a saved baseline, exit 2 on regression\n");
+    printf(" --save-baseline FILE   Save this session's raw latencies as a baseline\n");
+    printf(" --gate-alpha P         Significance level of the regression tests (default: 0.01)\n");
+    printf(" --gate-tolerance MS    Smallest percentile increase that counts (default: 0.5)\n");
+    printf(" --gate-tolerance-pct N Relative tolerance, the larger one applies (default: 5)\n");
+    printf(" --synthetic LAT[,JIT[,HZ[,SEED]]]  Synthetic capture source instead of DXGI (no input sent)\n");
+    printf(" --virtual-clock        Run a --synthetic session on a virtual clock (finishes in milliseconds)\n");
+    printf(" --metrics PORT Serve live Prometheus metrics on http://127.0.0.1:PORT/metrics\n");
+    printf(" --serve [NAME] Headless mode driven over the named pipe \\\\.\\pipe\\NAME (default: inputlag-tester)\n");
+    printf(" --sweep FILE   Run every cell of a test-matrix file, resumable, with a comparison table\n");
+    printf(" --sweep-wait SEC       Wait SEC seconds between sweep cells instead of prompting\n");
+    printf(" --simulate FILE        Measure the estimator's bias on simulated render pipelines (virtual clock)\n");
+    printf(" --benchmark FILE       Benchmark hashing, statistics, serialization and the sampling loop, JSON to FILE\n");
     printf(" --nb-run NUM   Number of test runs (default: 3)\n");
     printf(" --pause SEC    Pause between runs in seconds (default: 3)\n");
     printf(" --timeout MS   Max wait time for screen change in ms (default: 500)\n");
+    printf(" --stutter-factor X     Frame time above X times the median counts as stutter (default: 2.0)\n");
     printf(" --overlay      Enable overlay window (disabled by default)\n");
+    printf(" --rt           Real-time priority for input/capture threads (MMCSS, 1 ms timer)\n");
+    printf(" --pin CPUS     Pin input then capture threads to CPUS, e.g. 2,3 or 2-5\n");
+    printf(" --lock-memory  Lock measurement thread stacks and buffers in RAM\n");
+    printf(" --refresh-inventory  Re-collect CPU/BIOS/driver info instead of using the cache\n");
+    printf(" --dashboard    Live ANSI dashboard in the terminal (percentiles, histogram, error rates)\n");
     printf(" --overlay-size FACTOR  Overlay size scaling factor (default: 1.0)\n");
     printf(" -v             Verbose mode - display each sample\n");
     printf(" --diagnostic   Enable diagnostic mode (detailed logs)\n");
+    printf(" --trace FILE   Record hot-path phase spans, export Chrome trace JSON to FILE\n");
+    printf(" --flight-dir DIR       Directory for flight recorder dumps (default: current)\n");
+    printf(" --flight-outlier MS    Latency that triggers a dump (default: 0 = 3x running median)\n");
+    printf(" --flight-max-dumps NUM Max dumps per session, 0 disables (default: 10)\n");
+    printf(" --flight-depth NUM     Capture attempts per dump (default: 256, max: 4096)\n");
     printf(" --help         Show this help message\n\n");
     printf("Examples:\n");
     printf(" %s --diagnostic -n 50\n", programName);
     printf(" %s --diagnostic --overlay -n 50\n", programName);
+    printf(" %s --trace trace.json -n 50\n", programName);
+    printf(" %s --roi hud:40,980,300,80 --roi world:1500,300,400,300\n", programName);
+    printf(" %s --roi flash:900,500,120,80 --stimulus \"click:left@flash;move\"\n", programName);
+    printf(" %s --output 0:0 --output 0:1 -n 100\n", programName);
+    printf(" %s --sweep matrix.txt --nb-run 2\n", programName);
+    printf(" %s --simulate pipelines.txt\n", programName);
+    printf(" %s --benchmark bench.json\n", programName);
+    printf(" %s --baseline baseline.txt --nb-run 2\n", programName);
+    printf(" %s --synthetic 12,2,144 --save-baseline synth.txt\n", programName);
+    printf(" %s --store results --tag \"reflex on\" && %s --store results --history --tag \"reflex on\"\n", programName, programName);
     printf(" %s --overlay --overlay-size 1.5 -n 50\n", programName);
     printf(" %s --nb-run 5 --pause 2 -v --overlay --overlay-size 0.8\n", programName);
 }
@@ -259,97 +1126,537 @@ bool ParseCommandLineArgs(int argc, char* argv[]) {
             g_verbose = true;
             printf("[CONFIG] Diagnostic mode enabled\n");
         }
-        else if (arg == "--overlay") {
-            g_showOverlay = true;
-            printf("[CONFIG] Overlay enabled\n");
+        else if (arg == "--trace" && i + 1 < argc) {
+            g_traceFilePath = argv[++i];
+            g_traceEnabled = true;
+#if !INPUTLAG_TRACE
+            printf("[CONFIG] WARNING --trace ignored: built with INPUTLAG_TRACE=0\n");
+            g_traceEnabled = false;
+#else
+            printf("[CONFIG] Phase tracing enabled (output: %s)\n", g_traceFilePath.c_str());
+#endif
         }
-        else if (arg == "--overlay-size" && i + 1 < argc) {
-            g_overlaySizeFactor = std::atof(argv[++i]);
-            if (g_overlaySizeFactor <= 0.0) {
-                printf("[ERROR] --overlay-size must be > 0\n");
+        else if (arg == "--flight-dir" && i + 1 < argc) {
+            g_flightDir = argv[++i];
+            printf("[CONFIG] Flight recorder dumps written to %s\n", g_flightDir.c_str());
+        }
+        else if (arg == "--flight-outlier" && i + 1 < argc) {
+            g_flightOutlierMs = std::atof(argv[++i]);
+            if (g_flightOutlierMs < 0.0) {
+                printf("[ERROR] --flight-outlier must be >= 0\n");
                 return false;
             }
-            printf("[CONFIG] Overlay size factor set to %.2f\n", g_overlaySizeFactor);
+            printf("[CONFIG] Flight recorder outlier threshold set to %.2f ms\n", g_flightOutlierMs);
         }
-        else if (arg == "--timeout" && i + 1 < argc) {
-            g_maxWaitMs = std::atoi(argv[++i]);
-            if (g_maxWaitMs < 50) {
-                printf("[ERROR] --timeout must be >= 50 ms\n");
+        else if (arg == "--flight-max-dumps" && i + 1 < argc) {
+            g_flightMaxDumps = std::atoi(argv[++i]);
+            if (g_flightMaxDumps < 0) {
+                printf("[ERROR] --flight-max-dumps must be >= 0\n");
                 return false;
             }
-            printf("[CONFIG] Max wait timeout set to %d ms\n", g_maxWaitMs);
+            printf("[CONFIG] Flight recorder max dumps set to %d\n", g_flightMaxDumps);
         }
-        else if (arg == "--nb-run" && i + 1 < argc) {
-            g_nbRun = std::atoi(argv[++i]);
-            if (g_nbRun < 1) {
-                printf("[ERROR] --nb-run must be >= 1\n");
+        else if (arg == "--flight-depth" && i + 1 < argc) {
+            g_flightDepth = std::atoi(argv[++i]);
+            if (g_flightDepth < 1 || g_flightDepth > (int)kFlightCapacity) {
+                printf("[ERROR] --flight-depth must be between 1 and %zu\n", kFlightCapacity);
                 return false;
             }
-            printf("[CONFIG] NB_RUN set to %d\n", g_nbRun);
+            printf("[CONFIG] Flight recorder dump depth set to %d\n", g_flightDepth);
         }
-        else if (arg == "--pause" && i + 1 < argc) {
-            g_pauseSeconds = std::atoi(argv[++i]);
-            if (g_pauseSeconds < 0) {
-                printf("[ERROR] --pause must be >= 0\n");
+        else if (arg == "--stutter-factor" && i + 1 < argc) {
+            g_stutterFactor = std::atof(argv[++i]);
+            if (g_stutterFactor <= 1.0) {
+                printf("[ERROR] --stutter-factor must be > 1\n");
                 return false;
             }
-            printf("[CONFIG] PAUSE set to %d seconds\n", g_pauseSeconds);
+            printf("[CONFIG] Stutter threshold set to %.2fx median frame time\n", g_stutterFactor);
         }
-    }
-    return true;
-}
-
-// -------- Fonction de calcul des moyennes --------
-void PrintAverageResults() {
-    if (g_allResults.empty()) {
-        printf("\n[STATS] No results to average\n");
-        return;
-    }
-
-    printf("\n");
-    printf("==========================================\n");
-    printf(" AVERAGE RESULTS OVER %d RUNS\n", (int)g_allResults.size());
-    printf("==========================================\n\n");
-
-    std::vector<int64_t> allLatencies;
-    for (const auto& runResults : g_allResults) {
-        for (const auto& latency : runResults) {
-            allLatencies.push_back(latency);
+        else if (arg == "--stimulus" && i + 1 < argc) {
+            g_stimulusSpec = argv[++i];
+            printf("[CONFIG] Stimulus sequence: %s\n", g_stimulusSpec.c_str());
         }
-    }
-
-    if (allLatencies.empty()) {
-        printf("[STATS] No latency data collected\n");
-        return;
-    }
-
-    std::sort(allLatencies.begin(), allLatencies.end());
-
-    int64_t minNs = allLatencies.front();
-    int64_t maxNs = allLatencies.back();
-    int64_t sumNs = 0;
-    for (auto v : allLatencies) sumNs += v;
-    int64_t avgNs = sumNs / static_cast<int64_t>(allLatencies.size());
-
-    size_t p95_idx = static_cast<size_t>(allLatencies.size() * 0.95);
-    size_t p99_idx = static_cast<size_t>(allLatencies.size() * 0.99);
-    int64_t p95Ns = (p95_idx < allLatencies.size()) ? allLatencies[p95_idx] : allLatencies.back();
-    int64_t p99Ns = (p99_idx < allLatencies.size()) ? allLatencies[p99_idx] : allLatencies.back();
-
-    int64_t medianNs;
-    if (allLatencies.size() % 2 == 0) {
-        medianNs = (allLatencies[allLatencies.size()/2 - 1] + allLatencies[allLatencies.size()/2]) / 2;
-    } else {
-        medianNs = allLatencies[allLatencies.size()/2];
-    }
-
+        else if (arg == "--roi" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            size_t colon = spec.find(':');
+            CaptureRoi roi;
+            if (colon == std::string::npos || colon == 0 ||
+                sscanf_s(spec.c_str() + colon + 1, "%d,%d,%d,%d", &roi.x, &roi.y, &roi.w, &roi.h) != 4 ||
+                roi.w <= 0 || roi.h <= 0) {
+                printf("[ERROR] --roi expects NAME:X,Y,W,H (got '%s')\n", spec.c_str());
+                return false;
+            }
+            if ((int)g_extraRois.size() >= kMaxExtraRois) {
+                printf("[ERROR] At most %d --roi regions are supported\n", kMaxExtraRois);
+                return false;
+            }
+            roi.name = spec.substr(0, colon);
+            g_extraRois.push_back(roi);
+            printf("[CONFIG] ROI '%s' added: x=%d y=%d w=%d h=%d\n", roi.name.c_str(), roi.x, roi.y, roi.w, roi.h);
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            OutputSelection sel;
+            if (sscanf_s(argv[++i], "%d:%d", &sel.adapterIndex, &sel.outputIndex) != 2 ||
+                sel.adapterIndex < 0 || sel.outputIndex < 0) {
+                printf("[ERROR] --output expects ADAPTER:OUTPUT (e.g. 0:1)\n");
+                return false;
+            }
+            g_outputSelections.push_back(sel);
+            printf("[CONFIG] Output %d:%d selected\n", sel.adapterIndex, sel.outputIndex);
+        }
+        else if (arg == "--list-outputs") {
+            g_listOutputs = true;
+        }
+        else if (arg == "--store" && i + 1 < argc) {
+            g_storeDir = argv[++i];
+            printf("[CONFIG] Results store: %s\n", g_storeDir.c_str());
+        }
+        else if (arg == "--no-store") {
+            g_storeDir.clear();
+            printf("[CONFIG] Results store disabled\n");
+        }
+        else if (arg == "--tag" && i + 1 < argc) {
+            g_storeTag = argv[++i];
+            printf("[CONFIG] Session tag: %s\n", g_storeTag.c_str());
+        }
+        else if (arg == "--history") {
+            g_showHistory = true;
+        }
+        else if (arg == "--baseline" && i + 1 < argc) {
+            g_baselinePath = argv[++i];
+            printf("[CONFIG] Regression gate against baseline: %s\n", g_baselinePath.c_str());
+        }
+        else if (arg == "--save-baseline" && i + 1 < argc) {
+            g_saveBaselinePath = argv[++i];
+            printf("[CONFIG] Baseline will be saved to: %s\n", g_saveBaselinePath.c_str());
+        }
+        else if (arg == "--gate-alpha" && i + 1 < argc) {
+            g_gateAlpha = std::atof(argv[++i]);
+            if (g_gateAlpha <= 0.0 || g_gateAlpha >= 0.5) {
+                printf("[ERROR] --gate-alpha must be between 0 and 0.5\n");
+                return false;
+            }
+            printf("[CONFIG] Gate significance level: %.3f\n", g_gateAlpha);
+        }
+        else if (arg == "--gate-tolerance" && i + 1 < argc) {
+            g_gateToleranceMs = std::atof(argv[++i]);
+            if (g_gateToleranceMs < 0.0) {
+                printf("[ERROR] --gate-tolerance must be >= 0\n");
+                return false;
+            }
+            printf("[CONFIG] Gate tolerance: %.2f ms\n", g_gateToleranceMs);
+        }
+        else if (arg == "--gate-tolerance-pct" && i + 1 < argc) {
+            g_gateTolerancePct = std::atof(argv[++i]);
+            if (g_gateTolerancePct < 0.0) {
+                printf("[ERROR] --gate-tolerance-pct must be >= 0\n");
+                return false;
+            }
+            printf("[CONFIG] Gate tolerance: %.1f%%\n", g_gateTolerancePct);
+        }
+        else if (arg == "--synthetic" && i + 1 < argc) {
+            SyntheticCaptureConfig& cfg = g_synthetic;
+            cfg.enabled = true;
+            int fields = sscanf_s(argv[++i], "%lf,%lf,%d,%u", &cfg.latencyMs, &cfg.jitterMs, &cfg.refreshHz, &cfg.seed);
+            if (fields < 1 || cfg.latencyMs < 0.0 || cfg.jitterMs < 0.0 || cfg.refreshHz < 1 || cfg.refreshHz > 1000) {
+                printf("[ERROR] --synthetic expects LATENCY_MS[,JITTER_MS[,HZ[,SEED]]]\n");
+                return false;
+            }
+            printf("[CONFIG] Synthetic capture: %.2f ms +/- %.2f ms at %d Hz (no real input is sent)\n",
+                   cfg.latencyMs, cfg.jitterMs, cfg.refreshHz);
+        }
+        else if (arg == "--virtual-clock") {
+            g_clock = &g_virtualClock;
+            printf("[CONFIG] Virtual clock: delays, pauses and polling take no wall time (--synthetic only)\n");
+        }
+        else if (arg == "--metrics" && i + 1 < argc) {
+            g_metricsPort = std::atoi(argv[++i]);
+            if (g_metricsPort < 1 || g_metricsPort > 65535) {
+                printf("[ERROR] --metrics expects a TCP port (1-65535)\n");
+                return false;
+            }
+            printf("[CONFIG] Prometheus metrics on 127.0.0.1:%d\n", g_metricsPort);
+        }
+        else if (arg == "--serve") {
+            g_servePipeName = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : "inputlag-tester";
+            printf("[CONFIG] Control server on \\\\.\\pipe\\%s\n", g_servePipeName.c_str());
+        }
+        else if (arg == "--sweep" && i + 1 < argc) {
+            g_sweepFilePath = argv[++i];
+            printf("[CONFIG] Sweep mode, matrix file: %s\n", g_sweepFilePath.c_str());
+        }
+        else if (arg == "--benchmark" && i + 1 < argc) {
+            g_benchmarkFilePath = argv[++i];
+            printf("[CONFIG] Benchmark, results file: %s\n", g_benchmarkFilePath.c_str());
+        }
+        else if (arg == "--simulate" && i + 1 < argc) {
+            g_simulateFilePath = argv[++i];
+            printf("[CONFIG] Pipeline simulation, configuration file: %s\n", g_simulateFilePath.c_str());
+        }
+        else if (arg == "--sweep-wait" && i + 1 < argc) {
+            g_sweepWaitSeconds = std::atoi(argv[++i]);
+            if (g_sweepWaitSeconds < 0) {
+                printf("[ERROR] --sweep-wait must be >= 0\n");
+                return false;
+            }
+            printf("[CONFIG] Sweep: %d seconds between cells (no prompt)\n", g_sweepWaitSeconds);
+        }
+        else if (arg == "--rt") {
+            g_realtime = true;
+            printf("[CONFIG] Real-time scheduling for measurement threads (MMCSS / time-critical)\n");
+        }
+        else if (arg == "--pin" && i + 1 < argc) {
+            if (!ParseCpuList(argv[++i], g_pinCpus)) {
+                printf("[ERROR] --pin expects a CPU list such as 2,3 or 2-5 (CPUs 0-63)\n");
+                return false;
+            }
+            printf("[CONFIG] Measurement threads pinned to %zu CPU(s), input thread on CPU %d\n",
+                   g_pinCpus.size(), g_pinCpus.front());
+        }
+        else if (arg == "--lock-memory") {
+            g_lockMemory = true;
+            printf("[CONFIG] Measurement thread stacks and buffers locked in memory\n");
+        }
+        else if (arg == "--refresh-inventory") {
+            g_refreshInventory = true;
+            printf("[CONFIG] Hardware inventory cache ignored and rewritten\n");
+        }
+        else if (arg == "--dashboard") {
+            g_showDashboard = true;
+            printf("[CONFIG] Terminal dashboard enabled\n");
+        }
+        else if (arg == "--overlay") {
+            g_showOverlay = true;
+            printf("[CONFIG] Overlay enabled\n");
+        }
+        else if (arg == "--overlay-size" && i + 1 < argc) {
+            g_overlaySizeFactor = std::atof(argv[++i]);
+            if (g_overlaySizeFactor <= 0.0) {
+                printf("[ERROR] --overlay-size must be > 0\n");
+                return false;
+            }
+            printf("[CONFIG] Overlay size factor set to %.2f\n", g_overlaySizeFactor);
+        }
+        else if (arg == "--timeout" && i + 1 < argc) {
+            g_maxWaitMs = std::atoi(argv[++i]);
+            if (g_maxWaitMs < 50) {
+                printf("[ERROR] --timeout must be >= 50 ms\n");
+                return false;
+            }
+            printf("[CONFIG] Max wait timeout set to %d ms\n", g_maxWaitMs);
+        }
+        else if (arg == "--nb-run" && i + 1 < argc) {
+            g_nbRun = std::atoi(argv[++i]);
+            if (g_nbRun < 1) {
+                printf("[ERROR] --nb-run must be >= 1\n");
+                return false;
+            }
+            printf("[CONFIG] NB_RUN set to %d\n", g_nbRun);
+        }
+        else if (arg == "--pause" && i + 1 < argc) {
+            g_pauseSeconds = std::atoi(argv[++i]);
+            if (g_pauseSeconds < 0) {
+                printf("[ERROR] --pause must be >= 0\n");
+                return false;
+            }
+            printf("[CONFIG] PAUSE set to %d seconds\n", g_pauseSeconds);
+        }
+    }
+    return true;
+}
+
+// -------- Résumé statistique d'une série de latences --------
+struct LatencySummary {
+    size_t samples = 0;
+    int64_t minNs = 0;
+    int64_t p50Ns = 0;
+    int64_t avgNs = 0;
+    int64_t p95Ns = 0;
+    int64_t p99Ns = 0;
+    int64_t maxNs = 0;
+    double stdDevNs = 0.0;
+};
+
+LatencySummary ComputeLatencySummary(std::vector<int64_t> latencies) {
+    LatencySummary st;
+    if (latencies.empty()) return st;
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    st.samples = n;
+    st.minNs = latencies.front();
+    st.maxNs = latencies.back();
+    int64_t sumNs = 0;
+    for (auto v : latencies) sumNs += v;
+    st.avgNs = sumNs / static_cast<int64_t>(n);
+
+    st.p95Ns = SortedPercentile(latencies, 0.95);
+    st.p99Ns = SortedPercentile(latencies, 0.99);
+
+    if (n % 2 == 0) {
+        st.p50Ns = (latencies[n/2 - 1] + latencies[n/2]) / 2;
+    } else {
+        st.p50Ns = latencies[n/2];
+    }
+
     double variance = 0.0;
-    for (auto v : allLatencies) {
-        double diff = static_cast<double>(v) - static_cast<double>(avgNs);
+    for (auto v : latencies) {
+        double diff = static_cast<double>(v) - static_cast<double>(st.avgNs);
         variance += diff * diff;
     }
-    variance /= allLatencies.size();
-    double stdDev = sqrt(variance);
+    variance /= n;
+    st.stdDevNs = sqrt(variance);
+    return st;
+}
+
+// -------- Densité des latences (KDE) et modes --------
+// KDE gaussienne sur grille : les échantillons sont répartis linéairement sur kKdeGridPoints
+// points puis convolués par un noyau tronqué à ±4 h, soit O(n + G·K) après le tri, instantané
+// même sur une session d'endurance. Largeur de bande de Silverman, plafonnée au quart d'une
+// frame pour séparer les paquets que V-Sync ou un limiteur de FPS alignent sur le rafraîchissement.
+// Un mode est retenu si sa proéminence et sa part des échantillons sont suffisantes.
+static const int kKdeGridPoints = 512;
+static const double kModeMinProminence = 0.10;   // fraction de la densité du pic principal
+static const double kModeMinWeight = 0.05;       // fraction des échantillons
+static const double kQuantizedTolerance = 0.20;  // écart admis à un nombre entier de frames
+static const double kDriftMinStatistic = 0.10;   // D de Kolmogorov-Smirnov minimal pour une dérive
+
+struct LatencyMode {
+    double centerMs = 0.0;
+    double weight = 0.0;
+};
+
+struct LatencyDensity {
+    double bandwidthMs = 0.0;
+    std::vector<LatencyMode> modes;   // par latence croissante
+};
+
+LatencyDensity ComputeLatencyDensity(std::vector<int64_t> latencies, double frameTimeMs) {
+    LatencyDensity result;
+    size_t n = latencies.size();
+    if (n < 2) return result;
+    std::sort(latencies.begin(), latencies.end());
+
+    double mean = 0.0;
+    for (int64_t v : latencies) mean += v / 1000000.0;
+    mean /= n;
+    double variance = 0.0;
+    for (int64_t v : latencies) variance += (v / 1000000.0 - mean) * (v / 1000000.0 - mean);
+    double sd = sqrt(variance / (n - 1));
+    double iqr = (latencies[(3 * n) / 4] - latencies[n / 4]) / 1000000.0;
+    double spread = iqr > 0.0 ? (std::min)(sd, iqr / 1.34) : sd;
+    double h = 0.9 * spread * pow(static_cast<double>(n), -0.2);
+    h = (std::max)((std::min)(h, frameTimeMs / 4.0), 0.02);
+    result.bandwidthMs = h;
+
+    double lo = latencies.front() / 1000000.0 - 4.0 * h;
+    double hi = latencies.back() / 1000000.0 + 4.0 * h;
+    double step = (hi - lo) / (kKdeGridPoints - 1);
+
+    std::vector<double> bins(kKdeGridPoints, 0.0);
+    for (int64_t v : latencies) {
+        double pos = (v / 1000000.0 - lo) / step;
+        int g = (std::min)(static_cast<int>(pos), kKdeGridPoints - 2);
+        double frac = pos - g;
+        bins[g] += 1.0 - frac;
+        bins[g + 1] += frac;
+    }
+
+    int halfWidth = (std::min)(static_cast<int>(ceil(4.0 * h / step)), kKdeGridPoints - 1);
+    std::vector<double> kernel(halfWidth + 1);
+    for (int j = 0; j <= halfWidth; j++) kernel[j] = exp(-0.5 * (j * step / h) * (j * step / h));
+    std::vector<double> density(kKdeGridPoints, 0.0);
+    for (int g = 0; g < kKdeGridPoints; g++) {
+        if (bins[g] == 0.0) continue;
+        int from = (std::max)(g - halfWidth, 0);
+        int to = (std::min)(g + halfWidth, kKdeGridPoints - 1);
+        for (int k = from; k <= to; k++) density[k] += bins[g] * kernel[k > g ? k - g : g - k];
+    }
+
+    // Pics locaux et proéminence : hauteur au-dessus du plus haut des deux cols qui mènent
+    // à un point plus élevé (ou au bord de la grille)
+    double peakMax = *std::max_element(density.begin(), density.end());
+    std::vector<int> peaks;
+    for (int g = 1; g < kKdeGridPoints - 1; g++) {
+        if (density[g] <= density[g - 1] || density[g] < density[g + 1]) continue;
+        double leftMin = density[g], rightMin = density[g];
+        int k = g - 1;
+        for (; k >= 0 && density[k] <= density[g]; k--) leftMin = (std::min)(leftMin, density[k]);
+        if (k < 0) leftMin = 0.0;
+        k = g + 1;
+        for (; k < kKdeGridPoints && density[k] <= density[g]; k++) rightMin = (std::min)(rightMin, density[k]);
+        if (k >= kKdeGridPoints) rightMin = 0.0;
+        if (density[g] - (std::max)(leftMin, rightMin) >= kModeMinProminence * peakMax) peaks.push_back(g);
+    }
+
+    // Parts des échantillons entre les creux qui séparent des pics voisins ; les pics trop
+    // légers sont retirés puis les parts recalculées
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<double> weights;
+        int segmentStart = 0;
+        for (size_t p = 0; p < peaks.size(); p++) {
+            int segmentEnd = kKdeGridPoints;
+            if (p + 1 < peaks.size()) {
+                segmentEnd = static_cast<int>(std::min_element(density.begin() + peaks[p], density.begin() + peaks[p + 1])
+                                              - density.begin());
+            }
+            double mass = 0.0;
+            for (int g = segmentStart; g < segmentEnd; g++) mass += bins[g];
+            weights.push_back(mass / n);
+            segmentStart = segmentEnd;
+        }
+        if (pass == 1) {
+            for (size_t p = 0; p < peaks.size(); p++) {
+                int g = peaks[p];
+                double curvature = density[g - 1] - 2.0 * density[g] + density[g + 1];
+                double offset = curvature != 0.0 ? 0.5 * (density[g - 1] - density[g + 1]) / curvature : 0.0;
+                LatencyMode mode;
+                mode.centerMs = lo + (g + offset) * step;
+                mode.weight = weights[p];
+                result.modes.push_back(mode);
+            }
+            break;
+        }
+        std::vector<int> kept;
+        for (size_t p = 0; p < peaks.size(); p++) {
+            if (weights[p] >= kModeMinWeight) kept.push_back(peaks[p]);
+        }
+        peaks = kept;
+    }
+    return result;
+}
+
+// Modes espacés d'un nombre entier de frames (V-Sync, limiteur calé sur le rafraîchissement)
+bool IsRefreshQuantized(const LatencyDensity& density, double frameTimeMs) {
+    if (density.modes.size() < 2) return false;
+    for (size_t m = 1; m < density.modes.size(); m++) {
+        double frames = (density.modes[m].centerMs - density.modes[m - 1].centerMs) / frameTimeMs;
+        if (frames < 1.0 - kQuantizedTolerance || fabs(frames - floor(frames + 0.5)) > kQuantizedTolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Kolmogorov-Smirnov à deux échantillons (tri puis fusion, ex-aequo regroupés) ; p asymptotique
+double KolmogorovSmirnovPValue(std::vector<int64_t> a, std::vector<int64_t> b, double& statistic) {
+    statistic = 0.0;
+    if (a.empty() || b.empty()) return 1.0;
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        int64_t v = (std::min)(a[i], b[j]);
+        while (i < a.size() && a[i] == v) i++;
+        while (j < b.size() && b[j] == v) j++;
+        double d = fabs(static_cast<double>(i) / a.size() - static_cast<double>(j) / b.size());
+        statistic = (std::max)(statistic, d);
+    }
+
+    double ne = static_cast<double>(a.size()) * b.size() / (a.size() + b.size());
+    double lambda = (sqrt(ne) + 0.12 + 0.11 / sqrt(ne)) * statistic;
+    if (lambda < 0.3) return 1.0;
+    double p = 0.0, sign = 1.0;
+    for (int k = 1; k <= 100; k++) {
+        double term = sign * 2.0 * exp(-2.0 * k * k * lambda * lambda);
+        p += term;
+        if (fabs(term) < 1e-10) break;
+        sign = -sign;
+    }
+    return (std::min)((std::max)(p, 0.0), 1.0);
+}
+
+void PrintLatencyDistribution(const std::vector<int64_t>& allLatencies, double frameTimeMs, int64_t avgNs) {
+    LatencyDensity density = ComputeLatencyDensity(allLatencies, frameTimeMs);
+    if (density.modes.empty()) return;
+
+    printf("[*] Latency Distribution (KDE, bandwidth %.2f ms)\n", density.bandwidthMs);
+    for (size_t m = 0; m < density.modes.size(); m++) {
+        const LatencyMode& mode = density.modes[m];
+        printf("    Mode %zu    : %.2f ms (%.2f frames) - %.0f%% of samples\n", m + 1, mode.centerMs,
+               mode.centerMs / frameTimeMs, 100.0 * mode.weight);
+    }
+    if (density.modes.size() < 2) {
+        printf("    Verdict   : UNIMODAL - mean and percentiles describe a single cluster\n\n");
+        return;
+    }
+    for (size_t m = 1; m < density.modes.size(); m++) {
+        double spacingMs = density.modes[m].centerMs - density.modes[m - 1].centerMs;
+        printf("    Spacing   : %.2f ms = %.2f frames (mode %zu -> %zu)\n", spacingMs, spacingMs / frameTimeMs, m, m + 1);
+    }
+    if (IsRefreshQuantized(density, frameTimeMs)) {
+        printf("    Quantized : clusters sit whole frames apart at %d Hz (V-Sync or a frame cap)\n", g_monitorHz);
+    }
+    printf("    Verdict   : MULTIMODAL - the mean (%.2f ms) falls between clusters, read the modes instead\n\n",
+           avgNs / 1000000.0);
+}
+
+// -------- Statistiques par ROI (--roi) --------
+void PrintRoiResults(int64_t mainMedianNs) {
+    if (g_extraRois.empty()) return;
+
+    double frameTimeMs = 1000.0 / g_monitorHz;
+    printf("[*] Per-ROI Statistics (main region P50: %.2f ms)\n", mainMedianNs / 1000000.0);
+    for (size_t r = 0; r < g_extraRois.size(); r++) {
+        std::vector<int64_t> all;
+        for (const auto& run : g_roiResults[r]) all.insert(all.end(), run.begin(), run.end());
+
+        const CaptureRoi& roi = g_extraRois[r];
+        printf(" %-10s (%d,%d %dx%d) : ", roi.name.c_str(), roi.x, roi.y, roi.w, roi.h);
+        if (all.empty()) {
+            printf("no change detected (%d samples not changed)\n", g_roiUnchanged[r]);
+            continue;
+        }
+
+        std::sort(all.begin(), all.end());
+        size_t n = all.size();
+        int64_t sum = 0;
+        for (auto v : all) sum += v;
+        int64_t p50 = all[n / 2];
+        int64_t p95 = SortedPercentile(all, 0.95);
+        int64_t p99 = SortedPercentile(all, 0.99);
+
+        printf("Samples=%zu, Min=%.2f, P50=%.2f (%.2f fr), Avg=%.2f, P95=%.2f, P99=%.2f, Max=%.2f ms, "
+               "P50 vs main=%+.2f ms, NotChanged=%d\n",
+               n, all.front() / 1000000.0, p50 / 1000000.0, (p50 / 1000000.0) / frameTimeMs,
+               (sum / (double)n) / 1000000.0, p95 / 1000000.0, p99 / 1000000.0, all.back() / 1000000.0,
+               (p50 - mainMedianNs) / 1000000.0, g_roiUnchanged[r]);
+    }
+    printf("\n");
+}
+
+// -------- Fonction de calcul des moyennes --------
+void PrintAverageResults() {
+    if (g_allResults.empty()) {
+        printf("\n[STATS] No results to average\n");
+        return;
+    }
+
+    printf("\n");
+    printf("==========================================\n");
+    printf(" AVERAGE RESULTS OVER %d RUNS\n", (int)g_allResults.size());
+    printf("==========================================\n\n");
+
+    std::vector<int64_t> allLatencies;
+    for (const auto& runResults : g_allResults) {
+        for (const auto& latency : runResults) {
+            allLatencies.push_back(latency);
+        }
+    }
+
+    if (allLatencies.empty()) {
+        printf("[STATS] No latency data collected\n");
+        return;
+    }
+
+    LatencySummary summary = ComputeLatencySummary(allLatencies);
+    int64_t minNs = summary.minNs;
+    int64_t maxNs = summary.maxNs;
+    int64_t avgNs = summary.avgNs;
+    int64_t p95Ns = summary.p95Ns;
+    int64_t p99Ns = summary.p99Ns;
+    int64_t medianNs = summary.p50Ns;
+    double stdDev = summary.stdDevNs;
 
     double frameTimeMs = 1000.0 / g_monitorHz;
 
@@ -389,7 +1696,12 @@ void PrintAverageResults() {
     }
     printf("\n");
 
+    PrintLatencyDistribution(allLatencies, frameTimeMs, avgNs);
+    PrintFramePacingResults();
+    PrintRoiResults(medianNs);
+
     printf("[*] Per-Run Statistics\n");
+    int driftingRuns = 0;
     for (size_t runIdx = 0; runIdx < g_allResults.size(); runIdx++) {
         const auto& runResults = g_allResults[runIdx];
         if (runResults.empty()) continue;
@@ -404,10 +1716,9 @@ void PrintAverageResults() {
         int64_t runAvg = runSum / static_cast<int64_t>(sorted.size());
 
         int64_t runP50 = sorted[sorted.size() / 2];
-        size_t p99_idx_run = static_cast<size_t>(sorted.size() * 0.99);
-        int64_t runP99 = (p99_idx_run < sorted.size()) ? sorted[p99_idx_run] : sorted.back();
+        int64_t runP99 = SortedPercentile(sorted, 0.99);
 
-        printf(" Run %zu: Min=%.2f, P50=%.2f, Avg=%.2f, P99=%.2f, Max=%.2f ms, Samples=%zu\n",
+        printf(" Run %zu: Min=%.2f, P50=%.2f, Avg=%.2f, P99=%.2f, Max=%.2f ms, Samples=%zu",
                runIdx + 1,
                runMin / 1000000.0,
                runP50 / 1000000.0,
@@ -415,6 +1726,24 @@ void PrintAverageResults() {
                runP99 / 1000000.0,
                runMax / 1000000.0,
                sorted.size());
+
+        // Forme de la distribution du run et dérive par rapport au premier run
+        LatencyDensity runDensity = ComputeLatencyDensity(runResults, frameTimeMs);
+        printf(", Modes=%zu", runDensity.modes.size());
+        if (runDensity.modes.size() > 1) printf(" [MULTIMODAL]");
+        if (runIdx > 0 && !g_allResults[0].empty()) {
+            double ksStatistic = 0.0;
+            double ksP = KolmogorovSmirnovPValue(g_allResults[0], runResults, ksStatistic);
+            if (ksP < g_gateAlpha && ksStatistic >= kDriftMinStatistic) {
+                printf(" [DRIFT vs run 1: D=%.2f, p=%.4f]", ksStatistic, ksP);
+                driftingRuns++;
+            }
+        }
+        printf("\n");
+    }
+    if (driftingRuns > 0) {
+        printf(" -> %d run(s) drift from run 1 (Kolmogorov-Smirnov, alpha=%.3f): conditions changed during the session\n",
+               driftingRuns, g_gateAlpha);
     }
 
     printf("\n");
@@ -484,6 +1813,13 @@ void PrintDiagnosticStats() {
 }
 
 // -------- Helpers système --------
+static std::string TrimString(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return "";
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
 std::string GetCpuName() {
     HKEY hKey;
     const char* subKey = "HARDWARE\\DESCRIPTION\\System\\CentralProcessor\\0";
@@ -559,53 +1895,413 @@ std::string ReadBiosStringValue(const char* valueName) {
     return std::string(buffer);
 }
 
-std::string GetGpuDriverVersion() {
-    HKEY hKey;
-    const char* subKey = "SYSTEM\\CurrentControlSet\\Control\\Class\\{4D36E968-E325-11CE-BFC1-08002BE10318}\\0000";
-
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, subKey, 0, KEY_READ, &hKey) != ERROR_SUCCESS) {
+// Version du pilote de l'adaptateur capturé : la sous-clé de la classe Display dont le
+// MatchingDeviceId correspond à son VEN/DEV (la sous-clé 0000 n'est que le premier pilote
+// installé, pas forcément celui de ce GPU sur une machine multi-GPU)
+std::string GetGpuDriverVersion(int adapterIndex) {
+    ComPtr<IDXGIFactory1> factory;
+    if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory)))) return "Unknown";
+    ComPtr<IDXGIAdapter1> adapter;
+    if (FAILED(factory->EnumAdapters1(adapterIndex < 0 ? 0 : adapterIndex, adapter.GetAddressOf()))) return "Unknown";
+    DXGI_ADAPTER_DESC desc = {};
+    adapter->GetDesc(&desc);
+    char deviceId[32] = {};
+    sprintf_s(deviceId, sizeof(deviceId), "ven_%04x&dev_%04x", desc.VendorId, desc.DeviceId);
+
+    HKEY classKey;
+    const char* classPath = "SYSTEM\\CurrentControlSet\\Control\\Class\\{4D36E968-E325-11CE-BFC1-08002BE10318}";
+    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, classPath, 0, KEY_READ, &classKey) != ERROR_SUCCESS) {
         return "Unknown";
     }
 
-    char buffer[256] = {};
-    DWORD bufferSize = sizeof(buffer);
-    DWORD type = 0;
+    std::string version = "Unknown";
+    for (DWORD index = 0;; index++) {
+        char subKey[64] = {};
+        DWORD subKeySize = sizeof(subKey);
+        if (RegEnumKeyExA(classKey, index, subKey, &subKeySize, nullptr, nullptr, nullptr, nullptr) != ERROR_SUCCESS) break;
 
-    LONG ret = RegGetValueA(hKey, nullptr, "DriverVersion", RRF_RT_REG_SZ, &type, buffer, &bufferSize);
-    RegCloseKey(hKey);
+        char matching[256] = {};
+        DWORD matchingSize = sizeof(matching);
+        if (RegGetValueA(classKey, subKey, "MatchingDeviceId", RRF_RT_REG_SZ, nullptr, matching, &matchingSize) != ERROR_SUCCESS) {
+            continue;
+        }
+        for (char* c = matching; *c; c++) *c = static_cast<char>(tolower(static_cast<unsigned char>(*c)));
+        if (!strstr(matching, deviceId)) continue;
 
-    if (ret != ERROR_SUCCESS) {
-        return "Unknown";
+        char buffer[256] = {};
+        DWORD bufferSize = sizeof(buffer);
+        if (RegGetValueA(classKey, subKey, "DriverVersion", RRF_RT_REG_SZ, nullptr, buffer, &bufferSize) == ERROR_SUCCESS) {
+            version = buffer;
+        }
+        break;
     }
+    RegCloseKey(classKey);
+    return version;
+}
 
-    return std::string(buffer);
+// -------- Inventaire matériel asynchrone et en cache --------
+// Collecté sur un thread pendant l'initialisation de la capture, puis mis en cache dans
+// %TEMP% : tant que la machine n'a pas redémarré (BootId inchangé), les lancements suivants
+// relisent le fichier au lieu d'interroger le registre et DXGI. --refresh-inventory force la
+// collecte (mise à jour de pilote sans redémarrage).
+static const char* kInventoryCacheFile = "inputlag-tester-inventory.txt";
+static const int kInventoryCacheFormat = 1;
+
+struct HardwareInventory {
+    std::string cpuName;
+    std::string cpuCores;
+    double totalRamMB = 0.0;
+    std::string osVersion;
+    std::string mbVendor;
+    std::string mbProduct;
+    std::string biosVersion;
+    std::string gpuDriverVersion;
+    bool fromCache = false;
+    double collectMs = 0.0;
+};
+
+// Compteur de démarrages de Windows ; 0 si indisponible (pas de cache)
+DWORD GetBootId() {
+    DWORD bootId = 0;
+    DWORD size = sizeof(bootId);
+    const char* subKey = "SYSTEM\\CurrentControlSet\\Control\\Session Manager\\Memory Management\\PrefetchParameters";
+    if (RegGetValueA(HKEY_LOCAL_MACHINE, subKey, "BootId", RRF_RT_REG_DWORD, nullptr, &bootId, &size) != ERROR_SUCCESS) {
+        return 0;
+    }
+    return bootId;
+}
+
+static std::string InventoryCachePath() {
+    char tempDir[MAX_PATH] = {};
+    DWORD length = GetTempPathA(MAX_PATH, tempDir);
+    if (length == 0 || length >= MAX_PATH) return "";
+    return std::string(tempDir) + kInventoryCacheFile;
+}
+
+static bool LoadInventoryCache(const std::string& path, DWORD bootId, int adapterIndex, HardwareInventory& inv) {
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "r") != 0 || !f) return false;
+
+    std::map<std::string, std::string> values;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        std::string text = TrimString(line);
+        size_t eq = text.find('=');
+        if (eq != std::string::npos) values[text.substr(0, eq)] = text.substr(eq + 1);
+    }
+    fclose(f);
+
+    if (std::atoi(values["format"].c_str()) != kInventoryCacheFormat ||
+        std::strtoul(values["boot"].c_str(), nullptr, 10) != bootId ||
+        std::atoi(values["adapter"].c_str()) != adapterIndex) {
+        return false;
+    }
+    inv.cpuName = values["cpu"];
+    inv.cpuCores = values["cores"];
+    inv.totalRamMB = std::atof(values["ram_mb"].c_str());
+    inv.osVersion = values["os"];
+    inv.mbVendor = values["mb_vendor"];
+    inv.mbProduct = values["mb_product"];
+    inv.biosVersion = values["bios"];
+    inv.gpuDriverVersion = values["gpu_driver"];
+    return !inv.cpuName.empty() && !inv.gpuDriverVersion.empty();
+}
+
+static void SaveInventoryCache(const std::string& path, DWORD bootId, int adapterIndex, const HardwareInventory& inv) {
+    std::string tmp = path + ".tmp";
+    FILE* f = nullptr;
+    if (fopen_s(&f, tmp.c_str(), "w") != 0 || !f) return;
+    fprintf(f, "format=%d\nboot=%lu\nadapter=%d\n", kInventoryCacheFormat, (unsigned long)bootId, adapterIndex);
+    fprintf(f, "cpu=%s\ncores=%s\nram_mb=%.0f\nos=%s\n", inv.cpuName.c_str(), inv.cpuCores.c_str(),
+            inv.totalRamMB, inv.osVersion.c_str());
+    fprintf(f, "mb_vendor=%s\nmb_product=%s\nbios=%s\ngpu_driver=%s\n", inv.mbVendor.c_str(),
+            inv.mbProduct.c_str(), inv.biosVersion.c_str(), inv.gpuDriverVersion.c_str());
+    fclose(f);
+    MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
 }
 
-void InitMotherboardAndBiosInfo() {
-    g_mbVendor = ReadBiosStringValue("BaseBoardManufacturer");
-    g_mbProduct = ReadBiosStringValue("BaseBoardProduct");
-    g_biosVersion = ReadBiosStringValue("BIOSVersion");
+// Exécuté sur un thread à part (std::async) pendant l'init des moteurs de capture
+HardwareInventory LoadOrCollectHardwareInventory(int adapterIndex) {
+    int64_t startNs = TraceNowNs();
+    HardwareInventory inv;
+    DWORD bootId = GetBootId();
+    std::string cachePath = InventoryCachePath();
+    bool cacheUsable = bootId != 0 && !cachePath.empty();
+
+    if (cacheUsable && !g_refreshInventory && LoadInventoryCache(cachePath, bootId, adapterIndex, inv)) {
+        inv.fromCache = true;
+    } else {
+        inv.cpuName = GetCpuName();
+        inv.cpuCores = GetCpuLogicalCoresString();
+        inv.osVersion = GetOsVersionString();
+
+        MEMORYSTATUSEX mem = {};
+        mem.dwLength = sizeof(mem);
+        GlobalMemoryStatusEx(&mem);
+        inv.totalRamMB = mem.ullTotalPhys / (1024.0 * 1024.0);
+
+        inv.mbVendor = ReadBiosStringValue("BaseBoardManufacturer");
+        inv.mbProduct = ReadBiosStringValue("BaseBoardProduct");
+        inv.biosVersion = ReadBiosStringValue("BIOSVersion");
+        if (inv.mbVendor.empty()) inv.mbVendor = "Unknown";
+        if (inv.mbProduct.empty()) inv.mbProduct = "Unknown";
+        if (inv.biosVersion.empty()) inv.biosVersion = "Unknown";
+
+        inv.gpuDriverVersion = GetGpuDriverVersion(adapterIndex);
+        // Un échec de lecture du pilote ne doit pas rester en cache jusqu'au prochain redémarrage
+        if (cacheUsable && inv.gpuDriverVersion != "Unknown") SaveInventoryCache(cachePath, bootId, adapterIndex, inv);
+    }
+    inv.collectMs = (TraceNowNs() - startNs) / 1000000.0;
+    return inv;
+}
 
-    if (g_mbVendor.empty()) g_mbVendor = "Unknown";
-    if (g_mbProduct.empty()) g_mbProduct = "Unknown";
-    if (g_biosVersion.empty()) g_biosVersion = "Unknown";
+void ApplyHardwareInventory(const HardwareInventory& inv) {
+    g_cpuName = inv.cpuName;
+    g_cpuCores = inv.cpuCores;
+    g_totalRamMB = inv.totalRamMB;
+    g_osVersion = inv.osVersion;
+    g_mbVendor = inv.mbVendor;
+    g_mbProduct = inv.mbProduct;
+    g_biosVersion = inv.biosVersion;
+    g_gpuDriverVersion = inv.gpuDriverVersion;
+    printf("[INVENTORY] %s in %.1f ms\n", inv.fromCache ? "Loaded from cache" : "Collected", inv.collectMs);
 }
 
 // -------- Classe DXGICapture avec diagnostic --------
-class DXGICapture {
+// La région est découpée en kCaptureTileGrid x kCaptureTileGrid tuiles pour le flight recorder.
+// Tuiles et ROI supplémentaires partagent le même plan de hachage (voir RegionHashPlan).
+static const int kCaptureTileGrid = 4;
+static const int kCaptureTileCount = kCaptureTileGrid * kCaptureTileGrid;
+
+struct CaptureFrameInfo {
+    HRESULT hr = S_OK;
+    uint32_t checksum = 0;
+    int64_t timestampNs = 0;
+    int64_t acquireTimeUs = 0;
+    bool isMouseOnlyUpdate = false;
+    UINT accumulatedFrames = 0;
+    int64_t lastPresentQpc = 0;
+    // Dernière présentation et dernière mise à jour du curseur, dans la base de temps de
+    // timestampNs (0 : aucune depuis la capture précédente)
+    int64_t presentNs = 0;
+    int64_t cursorUpdateNs = 0;
+    uint16_t changedTiles = 0;
+    uint32_t roiChecksums[kMaxExtraRois] = {};
+};
+
+// Plan de hachage : bandes de lignes partageant le même ensemble de régions actives,
+// découpées en segments disjoints avec le masque des régions qui les couvrent.
+// Chaque pixel échantillonné n'est lu qu'une fois, même s'il appartient à plusieurs régions.
+// Indépendant de D3D : il hache n'importe quelle image BGRA en mémoire (voir aussi --benchmark).
+class RegionHashPlan {
+public:
+    void build(int regionX, int regionY, int regionW, int regionH,
+               const std::vector<CaptureRoi>& extraRois, int screenW, int screenH) {
+        std::vector<HashRect> rects;
+        for (int tr = 0; tr < kCaptureTileGrid; tr++) {
+            for (int tc = 0; tc < kCaptureTileGrid; tc++) {
+                HashRect r;
+                r.x0 = regionX + (regionW * tc) / kCaptureTileGrid;
+                r.x1 = regionX + (regionW * (tc + 1)) / kCaptureTileGrid;
+                r.y0 = regionY + (regionH * tr + kCaptureTileGrid - 1) / kCaptureTileGrid;
+                r.y1 = regionY + (regionH * (tr + 1) + kCaptureTileGrid - 1) / kCaptureTileGrid;
+                rects.push_back(r);
+            }
+        }
+        for (const CaptureRoi& roi : extraRois) {
+            rects.push_back({roi.x, roi.y, roi.x + roi.w, roi.y + roi.h});
+        }
+        regionCount_ = static_cast<int>(rects.size());
+
+        for (HashRect& r : rects) {
+            r.x0 = (std::max)(r.x0, 0);
+            r.y0 = (std::max)(r.y0, 0);
+            if (screenW > 0) r.x1 = (std::min)(r.x1, screenW);
+            if (screenH > 0) r.y1 = (std::min)(r.y1, screenH);
+        }
+
+        std::vector<int> yEdges;
+        for (const HashRect& r : rects) {
+            if (r.x1 <= r.x0 || r.y1 <= r.y0) continue;
+            yEdges.push_back(r.y0);
+            yEdges.push_back(r.y1);
+        }
+        std::sort(yEdges.begin(), yEdges.end());
+        yEdges.erase(std::unique(yEdges.begin(), yEdges.end()), yEdges.end());
+
+        hashSpans_.clear();
+        hashBands_.clear();
+        for (size_t e = 0; e + 1 < yEdges.size(); e++) {
+            HashBand band;
+            band.pyStart = alignToLattice(yEdges[e], regionY);
+            band.pyEnd = yEdges[e + 1];
+            if (band.pyStart >= band.pyEnd) continue;
+
+            std::vector<int> xEdges;
+            for (const HashRect& r : rects) {
+                if (r.x1 <= r.x0 || r.y0 > yEdges[e] || r.y1 < yEdges[e + 1]) continue;
+                xEdges.push_back(r.x0);
+                xEdges.push_back(r.x1);
+            }
+            std::sort(xEdges.begin(), xEdges.end());
+            xEdges.erase(std::unique(xEdges.begin(), xEdges.end()), xEdges.end());
+
+            band.spanBegin = hashSpans_.size();
+            for (size_t k = 0; k + 1 < xEdges.size(); k++) {
+                uint64_t mask = 0;
+                for (size_t i = 0; i < rects.size(); i++) {
+                    const HashRect& r = rects[i];
+                    if (r.y0 <= yEdges[e] && r.y1 >= yEdges[e + 1] &&
+                        r.x0 <= xEdges[k] && r.x1 >= xEdges[k + 1]) {
+                        mask |= 1ull << i;
+                    }
+                }
+                HashSpan span;
+                span.pxStart = alignToLattice(xEdges[k], regionX);
+                span.pxEnd = xEdges[k + 1];
+                span.mask = mask;
+                if (mask && span.pxStart < span.pxEnd) hashSpans_.push_back(span);
+            }
+            band.spanEnd = hashSpans_.size();
+            if (band.spanEnd > band.spanBegin) hashBands_.push_back(band);
+        }
+
+        coveredMask_ = 0;
+        for (const HashSpan& span : hashSpans_) coveredMask_ |= span.mask;
+    }
+
+    // XOR d'un pixel sur 4 dans chaque direction, accumulé par segment puis réparti sur les régions
+    void hash(const uint8_t* data, int pitch, uint32_t* hashes) const {
+        for (int i = 0; i < regionCount_; i++) hashes[i] = 0;
+        for (const HashBand& band : hashBands_) {
+            for (int py = band.pyStart; py < band.pyEnd; py += 4) {
+                const uint8_t* row = data + static_cast<size_t>(py) * pitch;
+                for (size_t sp = band.spanBegin; sp < band.spanEnd; sp++) {
+                    const HashSpan& span = hashSpans_[sp];
+                    uint32_t acc = 0;
+                    for (int px = span.pxStart; px < span.pxEnd; px += 4) {
+                        acc ^= *(const uint32_t*)(row + px * 4);
+                    }
+                    for (uint64_t m = span.mask; m; m &= m - 1) {
+                        unsigned long bit;
+                        _BitScanForward64(&bit, m);
+                        hashes[bit] ^= acc;
+                    }
+                }
+            }
+        }
+    }
+
+    int regionCount() const { return regionCount_; }
+    // Faux si la région ne contient aucun point de la grille d'échantillonnage (elle ne change jamais)
+    bool covers(int region) const { return (coveredMask_ >> region) & 1; }
+
+private:
+    struct HashSpan {
+        int pxStart, pxEnd;
+        uint64_t mask;
+    };
+    struct HashBand {
+        int pyStart, pyEnd;
+        size_t spanBegin, spanEnd;
+    };
+    struct HashRect {
+        int x0, y0, x1, y1;
+    };
+
+    std::vector<HashSpan> hashSpans_;
+    std::vector<HashBand> hashBands_;
+    int regionCount_ = 0;
+    uint64_t coveredMask_ = 0;
+
+    // Premier point de la grille d'échantillonnage (pas de 4, origine = coin de la région principale) >= v
+    static int alignToLattice(int v, int origin) {
+        int d = v - origin;
+        int q = d >= 0 ? (d + 3) / 4 : -((-d) / 4);
+        return origin + q * 4;
+    }
+};
+
+// Source de capture : DXGI Desktop Duplication, ou source synthétique (--synthetic) pour
+// valider la chaîne de mesure sans écran ni jeu.
+class CaptureBackend {
 public:
-    int refreshRateHz;
+    virtual ~CaptureBackend() {}
+
+    int refreshRateHz = 60;
+
+    virtual HRESULT init(int regionX, int regionY, int regionW, int regionH,
+                         const std::vector<CaptureRoi>& extraRois, int adapterIndex, int outputIndex) = 0;
+    virtual HRESULT captureFrame(CaptureFrameInfo& info) = 0;
+    virtual void setRegion(int regionX, int regionY, int regionW, int regionH) = 0;
+    // Appelé juste après l'envoi de l'input, avant que le moteur ne commence à sonder
+    virtual void onInputSent(int64_t inputTimeNs) { (void)inputTimeNs; }
+
+    HRESULT captureFrameWithTimestamp(uint32_t& checksumOut, int64_t& timestampNsOut) {
+        CaptureFrameInfo info;
+        HRESULT hr = captureFrame(info);
+        checksumOut = info.checksum;
+        timestampNsOut = info.timestampNs;
+        return hr;
+    }
 
-    HRESULT init(int regionX, int regionY, int regionW, int regionH) {
+    void setDiagnosticStats(DiagnosticStats* stats) { diagStats_ = stats; }
+    int screenWidth() const { return screenW_; }
+    int screenHeight() const { return screenH_; }
+    const std::string& gpuName() const { return gpuName_; }
+    const std::string& gpuVram() const { return gpuVram_; }
+    const std::string& monitorName() const { return monitorName_; }
+
+protected:
+    DiagnosticStats* diagStats_ = &g_diagStats;
+    int screenW_ = 0;
+    int screenH_ = 0;
+    std::string gpuName_;
+    std::string gpuVram_;
+    std::string monitorName_;
+};
+
+class DXGICapture : public CaptureBackend {
+public:
+    // adapterIndex = -1 : adaptateur par défaut de D3D11CreateDevice
+    HRESULT init(int regionX, int regionY, int regionW, int regionH,
+                 const std::vector<CaptureRoi>& extraRois,
+                 int adapterIndex, int outputIndex) override {
+        extraRois_ = extraRois;
         regionX_ = regionX;
         regionY_ = regionY;
         regionW_ = regionW;
         regionH_ = regionH;
         refreshRateHz = 60;
 
+        // Les horodatages DXGI sont en ticks QPC : écart mesuré une fois avec high_resolution_clock
+        LARGE_INTEGER freq, qpc;
+        QueryPerformanceFrequency(&freq);
+        QueryPerformanceCounter(&qpc);
+        int64_t clockNs = duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
+        qpcFrequency_ = freq.QuadPart > 0 ? freq.QuadPart : 1;
+        qpcOffsetNs_ = clockNs - qpcToNs(qpc.QuadPart, 0);
+
+        HRESULT hr;
+        ComPtr<IDXGIAdapter1> requestedAdapter;
+        if (adapterIndex >= 0) {
+            ComPtr<IDXGIFactory1> factory;
+            hr = CreateDXGIFactory1(IID_PPV_ARGS(&factory));
+            if (FAILED(hr)) {
+                printf("[DXGI] ERROR CreateDXGIFactory1 failed: 0x%X\n", hr);
+                return hr;
+            }
+            hr = factory->EnumAdapters1(adapterIndex, requestedAdapter.ReleaseAndGetAddressOf());
+            if (FAILED(hr)) {
+                printf("[DXGI] ERROR Adapter %d not found: 0x%X\n", adapterIndex, hr);
+                return hr;
+            }
+        }
+
         D3D_FEATURE_LEVEL featureLevels[] = {D3D_FEATURE_LEVEL_11_1, D3D_FEATURE_LEVEL_11_0};
-        HRESULT hr = D3D11CreateDevice(
-            nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
+        hr = D3D11CreateDevice(
+            requestedAdapter.Get(),
+            requestedAdapter ? D3D_DRIVER_TYPE_UNKNOWN : D3D_DRIVER_TYPE_HARDWARE, nullptr,
             D3D11_CREATE_DEVICE_BGRA_SUPPORT,
             featureLevels, ARRAYSIZE(featureLevels),
             D3D11_SDK_VERSION,
@@ -639,49 +2335,34 @@ public:
             char gpuName[128] = {};
             size_t converted = 0;
             wcstombs_s(&converted, gpuName, sizeof(gpuName), adapterDesc.Description, _TRUNCATE);
-            g_gpuName = gpuName;
-            g_gpuVram = FormatBytesToMB(static_cast<size_t>(adapterDesc.DedicatedVideoMemory));
+            gpuName_ = gpuName;
+            gpuVram_ = FormatBytesToMB(static_cast<size_t>(adapterDesc.DedicatedVideoMemory));
         }
 
         ComPtr<IDXGIOutput> output;
-        hr = adapter->EnumOutputs(0, output.ReleaseAndGetAddressOf());
+        hr = adapter->EnumOutputs(outputIndex, output.ReleaseAndGetAddressOf());
         if (FAILED(hr)) {
-            printf("[DXGI] ERROR EnumOutputs failed: 0x%X\n", hr);
+            printf("[DXGI] ERROR EnumOutputs(%d) failed: 0x%X\n", outputIndex, hr);
             return hr;
         }
 
-        detectRefreshRate(output.Get());
-
         DXGI_OUTPUT_DESC outputDesc;
         hr = output->GetDesc(&outputDesc);
         if (SUCCEEDED(hr)) {
-            int screenWidth = outputDesc.DesktopCoordinates.right - outputDesc.DesktopCoordinates.left;
-            printf("[DXGI] OK Screen resolution: %d x %d\n", screenWidth, 
-                   outputDesc.DesktopCoordinates.bottom - outputDesc.DesktopCoordinates.top);
-            printf("[DXGI] OK Detected refresh rate: %d Hz\n", refreshRateHz);
+            detectRefreshRate(outputDesc.DeviceName);
+
+            screenW_ = outputDesc.DesktopCoordinates.right - outputDesc.DesktopCoordinates.left;
+            screenH_ = outputDesc.DesktopCoordinates.bottom - outputDesc.DesktopCoordinates.top;
+            printf("[DXGI] OK Screen resolution: %d x %d\n", screenW_, screenH_);
 
             char monitorName[64] = {};
             size_t converted2 = 0;
             wcstombs_s(&converted2, monitorName, sizeof(monitorName), outputDesc.DeviceName, _TRUNCATE);
-            g_monitorName = monitorName;
-            g_monitorHz = refreshRateHz;
-
-            if (regionX_ == 0 && regionY_ == 0 && regionW_ == 0 && regionH_ == 0) {
-                regionW_ = 200;
-                regionH_ = 200;
-                regionX_ = (screenWidth / 2) - (regionW_ / 2);
-                regionY_ = (outputDesc.DesktopCoordinates.bottom - outputDesc.DesktopCoordinates.top) / 2 - (regionH_ / 2);
-                printf("[DXGI] OK Auto-region: x=%d y=%d w=%d h=%d (center)\n",
-                       regionX_, regionY_, regionW_, regionH_);
-            } else {
-                if (regionX_ + regionW_ > screenWidth) regionW_ = screenWidth - regionX_;
-                if (regionY_ + regionH_ > outputDesc.DesktopCoordinates.bottom) 
-                    regionH_ = outputDesc.DesktopCoordinates.bottom - regionY_;
-                printf("[DXGI] OK Capture region: x=%d y=%d w=%d h=%d\n",
-                       regionX_, regionY_, regionW_, regionH_);
-            }
+            monitorName_ = monitorName;
         }
 
+        applyRegion();
+
         ComPtr<IDXGIOutput1> output1;
         hr = output.As(&output1);
         if (FAILED(hr)) {
@@ -695,46 +2376,75 @@ public:
             return hr;
         }
 
+        // Le mode réellement actif de la sortie dupliquée fait foi
+        DXGI_OUTDUPL_DESC duplDesc = {};
+        duplication_->GetDesc(&duplDesc);
+        const DXGI_RATIONAL& rate = duplDesc.ModeDesc.RefreshRate;
+        if (rate.Numerator > 0 && rate.Denominator > 0) {
+            refreshRateHz = static_cast<int>((rate.Numerator + rate.Denominator / 2) / rate.Denominator);
+        }
+        printf("[DXGI] OK Active refresh rate: %d Hz\n", refreshRateHz);
+
         printf("[DXGI] OK Desktop Duplication initialized\n");
         return S_OK;
     }
 
-    HRESULT captureFrameWithTimestampDiag(uint32_t& checksumOut, int64_t& timestampNsOut, 
-                                          bool& isMouseOnlyUpdate, int64_t& acquireTimeUs) {
+    // Change la région entre deux sessions en réutilisant device et duplication
+    void setRegion(int regionX, int regionY, int regionW, int regionH) override {
+        regionX_ = regionX;
+        regionY_ = regionY;
+        regionW_ = regionW;
+        regionH_ = regionH;
+        applyRegion();
+        for (int t = 0; t < kCaptureTileCount; t++) prevTiles_[t] = 0;
+    }
+
+    HRESULT captureFrame(CaptureFrameInfo& info) override {
         ComPtr<IDXGIResource> desktopResource;
-        DXGI_OUTDUPL_FRAME_INFO frameInfo;
+        DXGI_OUTDUPL_FRAME_INFO frameInfo = {};
 
         int64_t captureTimeNs = duration_cast<nanoseconds>(
             high_resolution_clock::now().time_since_epoch()
         ).count();
+        info.timestampNs = captureTimeNs;
+        info.changedTiles = 0;
 
         auto acquireStart = high_resolution_clock::now();
-        HRESULT hr = duplication_->AcquireNextFrame(10, &frameInfo, desktopResource.ReleaseAndGetAddressOf());
+        HRESULT hr;
+        {
+            TRACE_SCOPE(PHASE_ACQUIRE_WAIT);
+            hr = duplication_->AcquireNextFrame(10, &frameInfo, desktopResource.ReleaseAndGetAddressOf());
+        }
         auto acquireDuration = duration_cast<microseconds>(high_resolution_clock::now() - acquireStart);
-        acquireTimeUs = acquireDuration.count();
-
-        isMouseOnlyUpdate = false;
+        info.acquireTimeUs = acquireDuration.count();
+        info.hr = hr;
+        info.accumulatedFrames = frameInfo.AccumulatedFrames;
+        info.lastPresentQpc = frameInfo.LastPresentTime.QuadPart;
+        info.presentNs = qpcToNs(frameInfo.LastPresentTime.QuadPart, qpcOffsetNs_);
+        info.cursorUpdateNs = qpcToNs(frameInfo.LastMouseUpdateTime.QuadPart, qpcOffsetNs_);
+
+        info.isMouseOnlyUpdate = false;
         if (SUCCEEDED(hr)) {
             if (frameInfo.LastMouseUpdateTime.QuadPart != 0 && 
                 frameInfo.TotalMetadataBufferSize == 0 &&
                 frameInfo.AccumulatedFrames == 0) {
-                isMouseOnlyUpdate = true;
+                info.isMouseOnlyUpdate = true;
                 if (g_diagnostic) {
-                    g_diagStats.mouseUpdatesOnly++;
+                    diagStats_->mouseUpdatesOnly++;
                 }
             }
         }
 
         if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
             if (g_diagnostic) {
-                g_diagStats.timeouts++;
+                diagStats_->timeouts++;
             }
             return hr;
         }
 
         if (FAILED(hr)) {
             if (g_diagnostic) {
-                g_diagStats.acquireErrors++;
+                diagStats_->acquireErrors++;
             }
             return hr;
         }
@@ -762,339 +2472,4085 @@ public:
             }
         }
 
-        context_->CopyResource(stagingTexture_.Get(), texture.Get());
+        {
+            TRACE_SCOPE(PHASE_COPY);
+            context_->CopyResource(stagingTexture_.Get(), texture.Get());
+        }
 
         D3D11_MAPPED_SUBRESOURCE mapped;
-        hr = context_->Map(stagingTexture_.Get(), 0, D3D11_MAP_READ, 0, &mapped);
+        {
+            TRACE_SCOPE(PHASE_MAP);
+            hr = context_->Map(stagingTexture_.Get(), 0, D3D11_MAP_READ, 0, &mapped);
+        }
         if (FAILED(hr)) {
             duplication_->ReleaseFrame();
+            info.hr = hr;
             return hr;
         }
 
-        uint32_t checksum = checksumRegion(
-            (uint8_t*)mapped.pData,
-            mapped.RowPitch,
-            regionX_, regionY_, regionW_, regionH_
-        );
+        uint32_t hashes[kCaptureTileCount + kMaxExtraRois];
+        {
+            TRACE_SCOPE(PHASE_HASH);
+            hashPlan_.hash((const uint8_t*)mapped.pData, mapped.RowPitch, hashes);
+        }
+
+        {
+            TRACE_SCOPE(PHASE_RELEASE);
+            context_->Unmap(stagingTexture_.Get(), 0);
+            duplication_->ReleaseFrame();
+        }
 
-        context_->Unmap(stagingTexture_.Get(), 0);
-        duplication_->ReleaseFrame();
+        // Checksum principal = XOR des tuiles ; résumé des tuiles modifiées depuis la dernière capture
+        uint32_t checksum = 0;
+        for (int t = 0; t < kCaptureTileCount; t++) {
+            checksum ^= hashes[t];
+            if (hashes[t] != prevTiles_[t]) info.changedTiles |= static_cast<uint16_t>(1u << t);
+            prevTiles_[t] = hashes[t];
+        }
+        for (size_t r = 0; r < extraRois_.size(); r++) {
+            info.roiChecksums[r] = hashes[kCaptureTileCount + r];
+        }
 
-        checksumOut = checksum;
-        timestampNsOut = captureTimeNs;
+        info.checksum = checksum;
 
         if (g_diagnostic) {
-            g_diagStats.successfulCaptures++;
+            diagStats_->successfulCaptures++;
         }
 
         return S_OK;
     }
 
-    HRESULT captureFrameWithTimestamp(uint32_t& checksumOut, int64_t& timestampNsOut) {
-        bool dummy1;
-        int64_t dummy2;
-        return captureFrameWithTimestampDiag(checksumOut, timestampNsOut, dummy1, dummy2);
-    }
-
 private:
     ComPtr<ID3D11Device> device_;
     ComPtr<ID3D11DeviceContext> context_;
     ComPtr<IDXGIOutputDuplication> duplication_;
     ComPtr<ID3D11Texture2D> stagingTexture_;
     int regionX_, regionY_, regionW_, regionH_;
+    uint32_t prevTiles_[kCaptureTileCount] = {};
+    int64_t qpcFrequency_ = 1;
+    int64_t qpcOffsetNs_ = 0;
+
+    // Ticks QPC -> ns sans débordement (qpc * 1e9 dépasse int64 après quelques heures) ; 0 reste 0
+    int64_t qpcToNs(int64_t qpc, int64_t offsetNs) const {
+        if (qpc == 0) return 0;
+        return (qpc / qpcFrequency_) * 1000000000ll + (qpc % qpcFrequency_) * 1000000000ll / qpcFrequency_ + offsetNs;
+    }
 
-    uint32_t checksumRegion(uint8_t* data, int pitch, int x, int y, int w, int h) {
-        uint32_t sum = 0;
-        for (int py = y; py < y + h; py += 4) {
-            for (int px = x; px < x + w; px += 4) {
-                if (py >= 0 && px >= 0) {
-                    uint32_t offset = py * pitch + px * 4;
-                    sum ^= *(uint32_t*)(data + offset);
-                }
-            }
+    std::vector<CaptureRoi> extraRois_;
+    RegionHashPlan hashPlan_;
+
+    // Taille par défaut 200x200 ; x / y à kRegionCentered : centré sur l'écran. La région est
+    // ensuite bornée à l'écran et le plan de hachage reconstruit
+    void applyRegion() {
+        if (screenW_ > 0 && screenH_ > 0) {
+            bool centered = regionX_ == kRegionCentered || regionY_ == kRegionCentered;
+            if (regionW_ <= 0) regionW_ = 200;
+            if (regionH_ <= 0) regionH_ = 200;
+            if (regionX_ == kRegionCentered) regionX_ = (screenW_ / 2) - (regionW_ / 2);
+            if (regionY_ == kRegionCentered) regionY_ = (screenH_ / 2) - (regionH_ / 2);
+            if (regionX_ + regionW_ > screenW_) regionW_ = screenW_ - regionX_;
+            if (regionY_ + regionH_ > screenH_) regionH_ = screenH_ - regionY_;
+            printf("[DXGI] OK %s: x=%d y=%d w=%d h=%d%s\n", centered ? "Auto-region" : "Capture region",
+                   regionX_, regionY_, regionW_, regionH_, centered ? " (center)" : "");
+        }
+        hashPlan_.build(regionX_, regionY_, regionW_, regionH_, extraRois_, screenW_, screenH_);
+        for (size_t r = 0; r < extraRois_.size(); r++) {
+            if (hashPlan_.covers(kCaptureTileCount + static_cast<int>(r))) continue;
+            const CaptureRoi& roi = extraRois_[r];
+            printf("[ROI] WARNING %s (%d,%d %dx%d) contains no sampled pixel (4 px grid aligned on the "
+                   "capture region): it will never change\n", roi.name.c_str(), roi.x, roi.y, roi.w, roi.h);
         }
-        return sum;
     }
 
-    void detectRefreshRate(IDXGIOutput* output) {
-        ComPtr<IDXGIOutput1> output1;
-        HRESULT hr = output->QueryInterface(IID_PPV_ARGS(&output1));
-        if (FAILED(hr)) {
-            printf("[DXGI] INFO Could not get IDXGIOutput1 for refresh rate detection\n");
+    // Fréquence du mode courant (et non la plus haute fréquence supportée)
+    void detectRefreshRate(const WCHAR* deviceName) {
+        DEVMODEW mode = {};
+        mode.dmSize = sizeof(mode);
+        if (!EnumDisplaySettingsW(deviceName, ENUM_CURRENT_SETTINGS, &mode) || mode.dmDisplayFrequency <= 1) {
+            printf("[DXGI] INFO Could not query current display mode\n");
             return;
         }
+        refreshRateHz = static_cast<int>(mode.dmDisplayFrequency);
+    }
+};
 
-        UINT numModes = 0;
-        hr = output1->GetDisplayModeList(DXGI_FORMAT_B8G8R8A8_UNORM, 0, &numModes, nullptr);
-        if (FAILED(hr) || numModes == 0) {
-            printf("[DXGI] INFO Could not enumerate display modes\n");
-            return;
+// Source synthétique : l'affichage présente une image à chaque vsync ; le contenu de la région
+// change au premier vsync suivant input + latence tirée (moyenne ± écart-type gaussien).
+// Permet de valider bout à bout moteurs, statistiques et --baseline sans écran ni jeu.
+class SyntheticCapture : public CaptureBackend {
+public:
+    SyntheticCapture(const SyntheticCaptureConfig& config, Clock& clock)
+        : config_(config), clock_(clock), rng_(config.seed) {}
+
+    HRESULT init(int regionX, int regionY, int regionW, int regionH,
+                 const std::vector<CaptureRoi>& extraRois, int adapterIndex, int outputIndex) override {
+        (void)adapterIndex;
+        roiCount_ = extraRois.size();
+        screenW_ = 1920;
+        screenH_ = 1080;
+        gpuName_ = "Synthetic capture";
+        gpuVram_ = "0 MB";
+        char name[32] = {};
+        sprintf_s(name, sizeof(name), "SYNTHETIC%d", outputIndex);
+        monitorName_ = name;
+        refreshRateHz = config_.refreshHz;
+        periodNs_ = 1000000000ll / refreshRateHz;
+        originNs_ = clock_.nowNs();
+
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        qpcFrequency_ = freq.QuadPart;
+
+        setRegion(regionX, regionY, regionW, regionH);
+        printf("[SYNTH] OK Synthetic capture: %d Hz, latency %.2f ms +/- %.2f ms\n",
+               refreshRateHz, config_.latencyMs, config_.jitterMs);
+        return S_OK;
+    }
+
+    void setRegion(int regionX, int regionY, int regionW, int regionH) override {
+        (void)regionX; (void)regionY; (void)regionW; (void)regionH;
+    }
+
+    void onInputSent(int64_t inputTimeNs) override {
+        std::normal_distribution<double> jitter(0.0, config_.jitterMs);
+        double latencyMs = config_.latencyMs + (config_.jitterMs > 0.0 ? jitter(rng_) : 0.0);
+        if (latencyMs < 0.0) latencyMs = 0.0;
+        readyTimesNs_.push_back(inputTimeNs + static_cast<int64_t>(latencyMs * 1000000.0));
+        cursorInputNs_ = inputTimeNs;
+    }
+
+    // Équivalent de AcquireNextFrame(10) : attend le prochain vsync ou expire
+    HRESULT captureFrame(CaptureFrameInfo& info) override {
+        int64_t startNs = clock_.nowNs();
+        info.timestampNs = startNs;
+        info.changedTiles = 0;
+        info.isMouseOnlyUpdate = false;
+
+        int64_t vsyncIndex = (startNs - originNs_) / periodNs_ + 1;
+        int64_t vsyncNs = originNs_ + vsyncIndex * periodNs_;
+        if (vsyncNs - startNs > 10000000) {
+            clock_.sleepUntilNs(startNs + 10000000);
+            info.acquireTimeUs = (clock_.nowNs() - startNs) / 1000;
+            info.hr = DXGI_ERROR_WAIT_TIMEOUT;
+            if (g_diagnostic) diagStats_->timeouts++;
+            return info.hr;
         }
 
-        std::vector<DXGI_MODE_DESC> modes(numModes);
-        hr = output1->GetDisplayModeList(DXGI_FORMAT_B8G8R8A8_UNORM, 0, &numModes, modes.data());
-        if (FAILED(hr)) {
-            printf("[DXGI] INFO Could not get display mode list\n");
-            return;
+        {
+            TRACE_SCOPE(PHASE_ACQUIRE_WAIT);
+            clock_.sleepUntilNs(vsyncNs);
+        }
+        info.timestampNs = clock_.nowNs();
+        info.acquireTimeUs = (info.timestampNs - startNs) / 1000;
+        info.hr = S_OK;
+        info.accumulatedFrames = 1;
+        info.lastPresentQpc = vsyncIndex * qpcFrequency_ / refreshRateHz;
+        info.presentNs = vsyncNs;
+        // Curseur matériel : déplacé au premier vsync qui suit l'input, sans latence applicative
+        if (cursorInputNs_ != 0 && cursorInputNs_ <= vsyncNs) {
+            info.cursorUpdateNs = vsyncNs;
+            cursorInputNs_ = 0;
         }
 
-        int maxRefreshRate = 60;
-        for (UINT i = 0; i < numModes; i++) {
-            if (modes[i].RefreshRate.Numerator > 0 && modes[i].RefreshRate.Denominator > 0) {
-                int refreshRate = modes[i].RefreshRate.Numerator / modes[i].RefreshRate.Denominator;
-                if (refreshRate > maxRefreshRate) {
-                    maxRefreshRate = refreshRate;
-                }
+        size_t before = shownChanges_;
+        while (shownChanges_ < readyTimesNs_.size() && readyTimesNs_[shownChanges_] <= vsyncNs) shownChanges_++;
+        if (shownChanges_ != before) info.changedTiles = 0xFFFF;
+
+        info.checksum = static_cast<uint32_t>((shownChanges_ + 1) * 2654435761u);
+        for (size_t r = 0; r < roiCount_; r++) {
+            info.roiChecksums[r] = info.checksum ^ static_cast<uint32_t>(r + 1);
+        }
+
+        if (g_diagnostic) diagStats_->successfulCaptures++;
+        return S_OK;
+    }
+
+private:
+    SyntheticCaptureConfig config_;
+    Clock& clock_;
+    std::mt19937 rng_;
+    size_t roiCount_ = 0;
+    int64_t periodNs_ = 0;
+    int64_t originNs_ = 0;
+    int64_t qpcFrequency_ = 1;
+    std::vector<int64_t> readyTimesNs_;
+    size_t shownChanges_ = 0;
+    int64_t cursorInputNs_ = 0;
+};
+
+// -------- Simulateur de pipeline de rendu (--simulate FILE) --------
+// Modèle paramétrique d'un jeu : cadence de rendu (± gigue), file de rendu de queue images,
+// synchronisation vsync / VRR / off, délai du compositeur, fréquence de l'écran. Le jeu lit
+// l'input au début de chaque image ; la région change à la présentation de la première image
+// affichée qui l'a lu. Le backend répond aux sondages du moteur sur une VirtualClock et connaît
+// la vraie latence de chaque input : le biais de l'estimateur (cadence de sondage, granularité
+// du timer, horodatage pris avant AcquireNextFrame) se mesure sans écran, plus vite que le temps réel.
+enum class PipelineSync { Vsync, Vrr, Off };
+
+struct PipelineSimConfig {
+    std::string name;
+    double gameFps = 144.0;
+    int queueDepth = 1;
+    PipelineSync sync = PipelineSync::Vsync;
+    double compositorMs = 0.0;
+    int refreshHz = 144;
+    double timerMs = 1.0;       // granularité du timer (Sleep) côté outil de mesure
+    double pollCostMs = 0.3;    // copie + map + hachage d'une image acquise
+    double jitterPct = 0.0;     // écart-type du temps de rendu, en % de 1/fps
+    uint32_t seed = 1;
+    int numSamples = 210;
+    int warmupSamples = 10;
+    int nbRun = 3;
+    int intervalMs = 50;
+};
+
+class PipelineSimCapture : public CaptureBackend {
+public:
+    PipelineSimCapture(const PipelineSimConfig& config, VirtualClock& clock)
+        : config_(config), clock_(clock), rng_(config.seed) {}
+
+    HRESULT init(int regionX, int regionY, int regionW, int regionH,
+                 const std::vector<CaptureRoi>& extraRois, int adapterIndex, int outputIndex) override {
+        (void)regionX; (void)regionY; (void)regionW; (void)regionH;
+        (void)extraRois; (void)adapterIndex; (void)outputIndex;
+        screenW_ = 1920;
+        screenH_ = 1080;
+        gpuName_ = "Simulated pipeline";
+        gpuVram_ = "0 MB";
+        monitorName_ = config_.name;
+        refreshRateHz = config_.refreshHz;
+        periodNs_ = 1000000000ll / refreshRateHz;
+        gameFrameNs_ = 1000000000.0 / config_.gameFps;
+        compositorNs_ = static_cast<int64_t>(config_.compositorMs * 1000000.0);
+        pollCostNs_ = static_cast<int64_t>(config_.pollCostMs * 1000000.0);
+        std::uniform_int_distribution<int64_t> phase(0, periodNs_ - 1);
+        vsyncPhaseNs_ = phase(rng_);
+        // Le jeu tourne depuis une seconde : la première acquisition trouve une image, comme DXGI
+        nextStartNs_ = clock_.nowNs() - 1000000000;
+
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        qpcFrequency_ = freq.QuadPart;
+        return S_OK;
+    }
+
+    void setRegion(int regionX, int regionY, int regionW, int regionH) override {
+        (void)regionX; (void)regionY; (void)regionW; (void)regionH;
+    }
+
+    void onInputSent(int64_t inputTimeNs) override {
+        inputsNs_.push_back(inputTimeNs);
+        cursorInputNs_ = inputTimeNs;
+    }
+
+    // Équivalent de AcquireNextFrame(10) : saute à la prochaine présentation ou expire
+    HRESULT captureFrame(CaptureFrameInfo& info) override {
+        int64_t startNs = clock_.nowNs();
+        int64_t deadlineNs = startNs + 10000000;
+        info.timestampNs = startNs;
+        info.changedTiles = 0;
+        info.isMouseOnlyUpdate = false;
+        generateUntil(deadlineNs);
+
+        if (delivered_ >= frames_.size() || frames_[delivered_].presentNs > deadlineNs) {
+            clock_.advanceTo(deadlineNs);
+            info.acquireTimeUs = (deadlineNs - startNs) / 1000;
+            info.hr = DXGI_ERROR_WAIT_TIMEOUT;
+            if (g_diagnostic) diagStats_->timeouts++;
+            return info.hr;
+        }
+
+        clock_.advanceTo(frames_[delivered_].presentNs);
+        int64_t acquiredNs = clock_.nowNs();
+        UINT accumulated = 0;
+        while (delivered_ < frames_.size() && frames_[delivered_].presentNs <= acquiredNs) {
+            delivered_++;
+            accumulated++;
+        }
+        const DesktopFrame& shown = frames_[delivered_ - 1];
+        settle(acquiredNs);
+
+        info.hr = S_OK;
+        info.acquireTimeUs = (acquiredNs - startNs) / 1000;
+        info.accumulatedFrames = accumulated;
+        info.presentNs = shown.presentNs;
+        info.lastPresentQpc = static_cast<int64_t>(shown.presentNs / 1e9 * static_cast<double>(qpcFrequency_));
+        if (cursorInputNs_ != 0 && nextVsync(cursorInputNs_) <= acquiredNs) {
+            info.cursorUpdateNs = nextVsync(cursorInputNs_);
+            cursorInputNs_ = 0;
+        }
+        size_t seen = std::upper_bound(inputsNs_.begin(), inputsNs_.end(), shown.gameStartNs) - inputsNs_.begin();
+        info.checksum = static_cast<uint32_t>((seen + 1) * 2654435761u);
+        if (changedSeen_ != seen) info.changedTiles = 0xFFFF;
+        changedSeen_ = seen;
+
+        clock_.advance(pollCostNs_);
+        if (g_diagnostic) diagStats_->successfulCaptures++;
+        return S_OK;
+    }
+
+    size_t inputCount() const { return inputsNs_.size(); }
+
+    // Vraie latence de l'input d'indice i (présentation de la première image qui l'a lu), 0 si inconnue
+    int64_t trueLatencyNs(size_t input) const {
+        return input < trueLatenciesNs_.size() ? trueLatenciesNs_[input] : 0;
+    }
+
+private:
+    struct DesktopFrame {
+        int64_t presentNs;
+        int64_t gameStartNs;   // lecture de l'input par l'image du jeu affichée
+    };
+
+    int64_t nextVsync(int64_t ns) const {
+        int64_t k = (ns - vsyncPhaseNs_ + periodNs_ - 1) / periodNs_;
+        return vsyncPhaseNs_ + k * periodNs_;
+    }
+
+    // Images du jeu jusqu'à ce qu'un flip dépasse t : toute image de bureau présentée avant t
+    // est alors définitive (une image plus récente ne peut plus la remplacer)
+    void generateUntil(int64_t t) {
+        while (flipsNs_.empty() || flipsNs_.back() <= t) {
+            double renderNs = gameFrameNs_;
+            if (config_.jitterPct > 0.0) {
+                std::normal_distribution<double> jitter(0.0, config_.jitterPct / 100.0);
+                renderNs *= (std::max)(1.0 + jitter(rng_), 0.1);
+            }
+
+            // La file est pleine tant que l'image k - queue n'a pas été flippée
+            size_t k = flipsNs_.size();
+            int64_t startNs = nextStartNs_;
+            if (k >= static_cast<size_t>(config_.queueDepth)) {
+                startNs = (std::max)(startNs, flipsNs_[k - config_.queueDepth]);
+            }
+            int64_t completeNs = startNs + static_cast<int64_t>(renderNs);
+            int64_t prevFlipNs = flipsNs_.empty() ? 0 : flipsNs_.back();
+
+            int64_t flipNs = completeNs;
+            int64_t presentNs = 0;
+            switch (config_.sync) {
+            case PipelineSync::Vsync:
+                flipNs = (std::max)(nextVsync(completeNs), prevFlipNs + periodNs_);
+                presentNs = flipNs + compositorNs_;
+                break;
+            case PipelineSync::Vrr:
+                flipNs = (std::max)(completeNs, prevFlipNs + periodNs_);
+                presentNs = flipNs + compositorNs_;
+                break;
+            case PipelineSync::Off:
+                // Le compositeur n'affiche que la dernière image flippée avant son vsync
+                presentNs = nextVsync(flipNs) + compositorNs_;
+                break;
+            }
+            flipsNs_.push_back(flipNs);
+            nextStartNs_ = completeNs;
+
+            if (!frames_.empty() && frames_.back().presentNs == presentNs) {
+                frames_.back().gameStartNs = startNs;
+            } else {
+                frames_.push_back({presentNs, startNs});
+            }
+        }
+    }
+
+    // Vraie latence des inputs lus par les images présentées jusqu'à t
+    void settle(int64_t t) {
+        while (settled_ < frames_.size() && frames_[settled_].presentNs <= t) {
+            const DesktopFrame& f = frames_[settled_++];
+            for (size_t i = trueLatenciesNs_.size(); i < inputsNs_.size() && inputsNs_[i] <= f.gameStartNs; i++) {
+                trueLatenciesNs_.push_back(f.presentNs - inputsNs_[i]);
             }
         }
-        refreshRateHz = maxRefreshRate;
     }
+
+    PipelineSimConfig config_;
+    VirtualClock& clock_;
+    std::mt19937 rng_;
+    int64_t periodNs_ = 0;
+    int64_t vsyncPhaseNs_ = 0;
+    double gameFrameNs_ = 0.0;
+    int64_t compositorNs_ = 0;
+    int64_t pollCostNs_ = 0;
+    int64_t qpcFrequency_ = 1;
+    int64_t nextStartNs_ = 0;
+    int64_t cursorInputNs_ = 0;
+    std::vector<int64_t> flipsNs_;
+    std::vector<DesktopFrame> frames_;
+    std::vector<int64_t> inputsNs_;
+    std::vector<int64_t> trueLatenciesNs_;
+    size_t delivered_ = 0;
+    size_t settled_ = 0;
+    size_t changedSeen_ = 0;
 };
 
-// ==================== Main ====================
-int main(int argc, char** argv) {
-    SetConsoleCP(CP_UTF8);
-    SetConsoleOutputCP(CP_UTF8);
+// -------- Métriques live (--metrics PORT) --------
+// Chaque moteur écrit ses compteurs et histogrammes (seul écrivain, atomiques relaxed) ;
+// le serveur HTTP les lit sans verrou, un scrape ne ralentit donc jamais la boucle de mesure.
+static const double kLatencyBucketsMs[] = {2, 4, 6, 8, 10, 12, 14, 16, 20, 25, 33, 50, 75, 100, 150, 250, 500};
+static const double kFrameBucketsMs[] = {2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 17, 20, 25, 33, 50, 100};
 
-    printf("\n========================================\n");
-    printf(" inputlag-tester with Overlay\n");
-    printf(" (Timeout: %d ms)\n", g_maxWaitMs);
-    printf("========================================\n\n");
+class AtomicHistogram {
+public:
+    static const size_t kMaxBuckets = 24;
 
-    if (!ParseCommandLineArgs(argc, argv)) {
-        return 1;
+    AtomicHistogram(const double* boundsMs, size_t count) : boundsMs_(boundsMs), count_(count) {}
+
+    void observe(double valueMs) {
+        size_t b = 0;
+        while (b < count_ && valueMs > boundsMs_[b]) b++;
+        buckets_[b].fetch_add(1, std::memory_order_relaxed);
+        sumUs_.fetch_add(static_cast<uint64_t>(valueMs * 1000.0), std::memory_order_relaxed);
     }
 
-    g_cpuName = GetCpuName();
-    g_osVersion = GetOsVersionString();
-    g_cpuCores = GetCpuLogicalCoresString();
+    // Écrit les séries _bucket (cumulées), _sum et _count au format texte Prometheus
+    void write(std::string& out, const char* name, const std::string& labels) const {
+        char line[256] = {};
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b <= count_; b++) {
+            cumulative += buckets_[b].load(std::memory_order_relaxed);
+            if (b < count_) {
+                sprintf_s(line, sizeof(line), "%s_bucket{%s,le=\"%g\"} %llu\n", name, labels.c_str(),
+                          boundsMs_[b] / 1000.0, (unsigned long long)cumulative);
+            } else {
+                sprintf_s(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels.c_str(),
+                          (unsigned long long)cumulative);
+            }
+            out += line;
+        }
+        sprintf_s(line, sizeof(line), "%s_sum{%s} %.6f\n%s_count{%s} %llu\n", name, labels.c_str(),
+                  sumUs_.load(std::memory_order_relaxed) / 1000000.0, name, labels.c_str(),
+                  (unsigned long long)cumulative);
+        out += line;
+    }
 
-    MEMORYSTATUSEX mem = {};
-    mem.dwLength = sizeof(mem);
-    GlobalMemoryStatusEx(&mem);
-    g_totalRamMB = mem.ullTotalPhys / (1024.0 * 1024.0);
+private:
+    const double* boundsMs_;
+    size_t count_;
+    std::atomic<uint64_t> buckets_[kMaxBuckets + 1] = {};
+    std::atomic<uint64_t> sumUs_{0};
+};
 
-    InitMotherboardAndBiosInfo();
-    g_gpuDriverVersion = GetGpuDriverVersion();
+struct EngineMetrics {
+    std::atomic<uint64_t> polls{0};
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> noChange{0};
+    std::atomic<uint64_t> acquireTimeouts{0};
+    std::atomic<uint64_t> acquireErrors{0};
+    std::atomic<uint64_t> presentedFrames{0};
+    AtomicHistogram latency{kLatencyBucketsMs, ARRAYSIZE(kLatencyBucketsMs)};
+    AtomicHistogram frameInterval{kFrameBucketsMs, ARRAYSIZE(kFrameBucketsMs)};
+
+    // Dernières latences (µs) en anneau et progression du run, lues par le tableau de bord
+    static constexpr size_t kRecentSamples = 1024;
+    std::atomic<uint32_t> recentLatencyUs[kRecentSamples] = {};
+    std::atomic<int> run{0};
+    std::atomic<int> runSample{0};
+    std::atomic<int> runSamples{0};
+
+    void recordLatency(double latencyMs) {
+        uint64_t slot = samples.load(std::memory_order_relaxed) % kRecentSamples;
+        recentLatencyUs[slot].store(static_cast<uint32_t>(latencyMs * 1000.0), std::memory_order_relaxed);
+        samples.fetch_add(1, std::memory_order_release);
+        latency.observe(latencyMs);
+    }
+};
 
-    int regionX = 0, regionY = 0, regionW = 0, regionH = 0;
-    int numSamples = 210;
-    int warmupSamples = 10;
-    int intervalMs = 50;
-    int dx = 30;
+// -------- Moteurs de capture multi-sorties --------
+// Un moteur par sortie sélectionnée (--output), chacun avec son device D3D11, sa session de
+// duplication et son thread. Le thread principal envoie l'input puis arme tous les moteurs ;
+// chaque moteur sonde sa sortie jusqu'au changement ou au timeout.
+// Décomposition de la latence (échantillons hors warmup où la région a changé), d'après les
+// horodatages du backend : input -> mise à jour du curseur, input -> première image composée
+// après l'input, input -> présentation de l'image où la région change. L'écart entre les deux
+// dernières étapes est la part de l'application (rendu + file de présentation).
+struct LatencyStages {
+    std::vector<int64_t> cursorNs;
+    std::vector<int64_t> composedNs;
+    std::vector<int64_t> regionNs;
+    std::vector<int64_t> applicationNs;
+    size_t cursorMissing = 0;
+
+    void reserve(size_t moreSamples) {
+        for (std::vector<int64_t>* v : {&cursorNs, &composedNs, &regionNs, &applicationNs}) {
+            v->reserve(v->size() + moreSamples);
+        }
+    }
 
-    for (int i = 1; i < argc; i++) {
-        std::string arg = argv[i];
-        if (arg == "-x" && i + 1 < argc) regionX = atoi(argv[++i]);
-        else if (arg == "-y" && i + 1 < argc) regionY = atoi(argv[++i]);
-        else if (arg == "-w" && i + 1 < argc) regionW = atoi(argv[++i]);
-        else if (arg == "-h" && i + 1 < argc) regionH = atoi(argv[++i]);
-        else if (arg == "-n" && i + 1 < argc) numSamples = atoi(argv[++i]);
-        else if (arg == "-warmup" && i + 1 < argc) warmupSamples = atoi(argv[++i]);
-        else if (arg == "-interval" && i + 1 < argc) intervalMs = atoi(argv[++i]);
-        else if (arg == "-dx" && i + 1 < argc) dx = atoi(argv[++i]);
-        else if (arg == "-o" && i + 1 < argc) g_outputFilePath = argv[++i];
+    void clear() {
+        cursorNs.clear();
+        composedNs.clear();
+        regionNs.clear();
+        applicationNs.clear();
+        cursorMissing = 0;
+    }
+};
+
+struct EngineSampleResult {
+    bool found = false;
+    int64_t latencyNs = 0;
+    int64_t acquireTimeUs = 0;
+    bool mouseOnly = false;
+    int waitCount = 0;
+};
+
+class CaptureEngine {
+public:
+    CaptureEngine(int index, const OutputSelection& selection)
+        : index_(index), selection_(selection), clock_(g_clock) {
+        if (g_synthetic.enabled) {
+            SyntheticCaptureConfig config = g_synthetic;
+            if (config.seed == 0) config.seed = static_cast<uint32_t>(time(nullptr));
+            config.seed += static_cast<uint32_t>(index);
+            capture = std::make_unique<SyntheticCapture>(config, *clock_);
+        } else {
+            capture = std::make_unique<DXGICapture>();
+        }
+        capture->setDiagnosticStats(&stats);
     }
 
-    printf("Config: dx=%d interval=%dms n=%d warmup=%d timeout=%dms\n\n", 
-           dx, intervalMs, numSamples, warmupSamples, g_maxWaitMs);
+    // Backend fourni par l'appelant, sondé sur son horloge (simulateur : VirtualClock)
+    CaptureEngine(int index, std::unique_ptr<CaptureBackend> backend, Clock& clock)
+        : index_(index), clock_(&clock) {
+        capture = std::move(backend);
+        capture->setDiagnosticStats(&stats);
+    }
 
-    DXGICapture capture;
-    HRESULT hr = capture.init(regionX, regionY, regionW, regionH);
-    if (FAILED(hr)) {
-        printf("[ERROR] Capture init failed: 0x%X\n", hr);
-        return 1;
+    ~CaptureEngine() { shutdown(); }
+
+    HRESULT init(int regionX, int regionY, int regionW, int regionH, const std::vector<CaptureRoi>& rois) {
+        roiCount_ = rois.size();
+        roiLatencies.assign(roiCount_, {});
+        roiUnchanged.assign(roiCount_, 0);
+        return capture->init(regionX, regionY, regionW, regionH, rois,
+                            selection_.adapterIndex, selection_.outputIndex);
     }
 
-    double frameTimeMs = 1000.0 / capture.refreshRateHz;
-    g_overlayFrameTimeMs = frameTimeMs;
-    printf("Monitor: %dHz (%.2f ms per frame)\n\n", capture.refreshRateHz, frameTimeMs);
+    void start() {
+        thread_ = std::thread(&CaptureEngine::threadMain, this);
+    }
 
-    // Créer l'overlay si activé
-    if (g_showOverlay) {
-        CreateOverlayWindow();
+    void shutdown() {
+        if (!thread_.joinable()) return;
+        post(Command::Quit);
+        thread_.join();
     }
 
-    printf("\n========================================\n");
-    printf(" STARTING MULTI-RUN TEST\n");
-    printf(" Runs  : %d\n", g_nbRun);
-    printf(" Pause : %d seconds\n", g_pauseSeconds);
-    if (g_diagnostic) {
-        printf(" Mode  : DIAGNOSTIC ENABLED\n");
+    // Capture de référence et remise à zéro des séries (bloquant)
+    void beginRun(int runNumber, int numSamples, int warmupSamples) {
+        prepareRun(runNumber, numSamples, warmupSamples);
+        post(Command::Baseline);
+        while (busy()) Sleep(1);
     }
-    if (g_showOverlay) {
-        printf(" Overlay: ENABLED (top-right corner, scale: %.2f)\n", g_overlaySizeFactor);
+
+    void prepareRun(int runNumber, int numSamples, int warmupSamples) {
+        runNumber_ = runNumber;
+        warmupSamples_ = warmupSamples;
+        runLatencies.emplace_back();
+        runLatencies.back().reserve(numSamples);
+        for (auto& roiRuns : roiLatencies) {
+            roiRuns.emplace_back();
+            roiRuns.back().reserve(numSamples);
+        }
+        stages.reserve(numSamples);
+        outlierScratch_.reserve(numSamples);
+        nextOutlierUpdate_ = 0;
+        pacing_.reset(static_cast<size_t>(numSamples) * 64);
+        scheduling.lockedBytes += LockHotBuffer(runLatencies.back().data(), numSamples * sizeof(int64_t));
+        scheduling.lockedBytes += LockHotBuffer(pacing_.intervalsMs().data(),
+                                                pacing_.intervalsMs().capacity() * sizeof(double));
+        metrics.runSamples.store(numSamples, std::memory_order_relaxed);
+        metrics.runSample.store(0, std::memory_order_relaxed);
+        metrics.run.store(runNumber, std::memory_order_relaxed);
     }
-    printf("========================================\n\n");
 
-    g_overlayTotalRuns = g_nbRun;
-    g_overlayTotalSamples = numSamples;
+    void resetResults() {
+        runLatencies.clear();
+        roiLatencies.assign(roiCount_, {});
+        roiUnchanged.assign(roiCount_, 0);
+        frameIntervalsMs.clear();
+        coalescedFrames = 0;
+        stages.clear();
+        outlierThresholdNs_ = 0;
+    }
 
-    for (int runNumber = 1; runNumber <= g_nbRun; runNumber++) {
-        g_overlayCurrentRun = runNumber;
-        g_overlaySampleCount = 0;
-        g_overlayLastError = "";
-        UpdateOverlay();
+    void endRun() {
+        frameIntervalsMs.push_back(pacing_.intervalsMs());
+        coalescedFrames += pacing_.coalescedFrames();
+    }
 
-        printf("\n===============================================\n");
-        printf(" RUN %d / %d\n", runNumber, g_nbRun);
-        printf("===============================================\n\n");
+    // Démarre le sondage pour l'échantillon courant (non bloquant) ; targetRoi >= 0 : la
+    // latence de l'échantillon est celle de cette ROI (stimulus @roi) et non de la région
+    void armSample(int sampleIndex, int64_t inputTimeNs, int targetRoi) {
+        sampleIndex_ = sampleIndex;
+        inputTimeNs_ = inputTimeNs;
+        targetRoi_ = targetRoi;
+        capture->onInputSent(inputTimeNs);
+        post(Command::Sample);
+    }
 
-        g_results.clear();
+    // Variantes synchrones, exécutées sur le thread appelant (simulateur, sans thread moteur)
+    void measureBaseline() { runBaseline(); }
 
-        printf("[OK] Starting test in 3 seconds...\n");
-        Sleep(3000);
-        printf("[OK] Measurements starting...\n\n");
+    void measureSample(int sampleIndex, int64_t inputTimeNs, int targetRoi) {
+        sampleIndex_ = sampleIndex;
+        inputTimeNs_ = inputTimeNs;
+        targetRoi_ = targetRoi;
+        capture->onInputSent(inputTimeNs);
+        runSample();
+    }
 
-        int sampleCount = 0;
-        uint32_t baselineChecksum = 0;
-        ULONGLONG nextInputTime = GetTickCount64() + intervalMs;
+    bool busy() const { return busy_.load(std::memory_order_acquire); }
+    const EngineSampleResult& sampleResult() const { return result_; }
+    int index() const { return index_; }
+    double frameTimeMs() const { return 1000.0 / capture->refreshRateHz; }
+
+    std::unique_ptr<CaptureBackend> capture;
+    DiagnosticStats stats;
+    EngineMetrics metrics;
+    ThreadScheduling scheduling;
+    std::vector<std::vector<int64_t>> runLatencies;               // [run][sample]
+    std::vector<std::vector<std::vector<int64_t>>> roiLatencies;  // [roi][run][sample]
+    std::vector<int> roiUnchanged;
+    std::vector<std::vector<double>> frameIntervalsMs;            // [run][frame]
+    size_t coalescedFrames = 0;
+    LatencyStages stages;
 
-        int64_t dummyTs = 0;
-        capture.captureFrameWithTimestamp(baselineChecksum, dummyTs);
+private:
+    enum class Command { None, Baseline, Sample, Quit };
 
-        while (sampleCount < numSamples) {
-            if (GetTickCount64() >= nextInputTime) {
-                INPUT inp = {};
-                inp.type = INPUT_MOUSE;
-                inp.mi.dx = (sampleCount % 2 == 0) ? dx : -dx;
-                inp.mi.dy = 0;
-                inp.mi.dwFlags = MOUSEEVENTF_MOVE;
+    void post(Command command) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        command_ = command;
+        busy_.store(true, std::memory_order_release);
+        cv_.notify_one();
+    }
 
-                int64_t inputTimeNs = duration_cast<nanoseconds>(
-                    high_resolution_clock::now().time_since_epoch()
-                ).count();
+    void threadMain() {
+        char name[32] = {};
+        sprintf_s(name, sizeof(name), "capture-%d", index_);
+        if (g_traceEnabled) {
+            TraceRegisterCurrentThread(name);
+        }
+        ApplyThreadScheduling(scheduling, name, 1 + index_);
+        for (;;) {
+            Command command;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return command_ != Command::None; });
+                command = command_;
+                command_ = Command::None;
+            }
+            if (command == Command::Quit) break;
+            if (command == Command::Baseline) runBaseline();
+            if (command == Command::Sample) runSample();
+            busy_.store(false, std::memory_order_release);
+        }
+        RevertThreadScheduling(scheduling);
+    }
 
-                SendInput(1, &inp, sizeof(INPUT));
+    void runBaseline() {
+        CaptureFrameInfo baselineFrame;
+        capture->captureFrame(baselineFrame);
+        baselineChecksum_ = baselineFrame.checksum;
+        for (size_t r = 0; r < roiCount_; r++) roiBaselines_[r] = baselineFrame.roiChecksums[r];
+    }
 
-                bool found = false;
-                int waitCount = 0;
-                int maxWaitCount = g_maxWaitMs;
+    void runSample() {
+        EngineSampleResult result;
+        int maxWaitCount = g_maxWaitMs;
+        std::vector<int64_t>& results = runLatencies.back();
 
-                while (waitCount < maxWaitCount && !found) {
-                    uint32_t checksum = 0;
-                    int64_t captureTimeNs = 0;
-                    bool isMouseOnly = false;
-                    int64_t acquireTimeUs = 0;
+        // Les ROI supplémentaires restent surveillées kRoiGraceFrames après la région principale ;
+        // celles qui n'ont pas changé d'ici là sont comptées comme inchangées (HUD statique)
+        uint64_t roiPending = roiCount_ == 0 ? 0 : (~0ull >> (64 - roiCount_));
+        int64_t roiGraceEndNs = 0;
 
-                    HRESULT captureHr;
-                    if (g_diagnostic) {
-                        g_diagStats.totalAttempts++;
-                        captureHr = capture.captureFrameWithTimestampDiag(checksum, captureTimeNs, 
-                                                                          isMouseOnly, acquireTimeUs);
-                    } else {
-                        captureHr = capture.captureFrameWithTimestamp(checksum, captureTimeNs);
-                    }
+        flightPendingReason_ = nullptr;
+        uint32_t targetRoiBaseline = targetRoi_ < 0 ? 0 : roiBaselines_[targetRoi_];
+        int64_t cursorStageNs = 0;
+        int64_t composedStageNs = 0;
 
-                    if (SUCCEEDED(captureHr)) {
-                        if (checksum != baselineChecksum) {
-                            int64_t latencyNs = captureTimeNs - inputTimeNs;
-
-                            if (latencyNs > 0 && latencyNs < 500000000) {
-                                if (sampleCount >= warmupSamples) {
-                                    g_results.push_back(latencyNs);
-                                }
-
-                                sampleCount++;
-                                g_overlaySampleCount = sampleCount;
-                                double latencyMs = latencyNs / 1000000.0;
-                                g_overlayLastLatency = latencyMs;
-                                g_overlayLastError = "";
-                                double frames = latencyMs / frameTimeMs;
-
-                                if (g_verbose) {
-                                    if (g_diagnostic) {
-                                        printf("[%d/%d] Latency: %.2f ms (%.2f frames) [AcquireTime: %lld µs%s]\n",
-                                               sampleCount, numSamples, latencyMs, frames, 
-                                               (long long)acquireTimeUs,
-                                               isMouseOnly ? ", MouseOnly" : "");
-                                    } else {
-                                        printf("[%d/%d] Latency: %.2f ms (%.2f frames)\n",
-                                               sampleCount, numSamples, latencyMs, frames);
-                                    }
-                                }
-
-                                baselineChecksum = checksum;
-                                if (g_diagnostic) {
-                                    g_diagStats.checksumChanges++;
-                                }
-                                found = true;
-                            }
-                        } else {
-                            if (g_diagnostic) {
-                                g_diagStats.sameChecksum++;
-                            }
-                        }
-                    }
+        while (result.waitCount < maxWaitCount &&
+               (!result.found || (roiPending && clock_->nowNs() < roiGraceEndNs))) {
+            CaptureFrameInfo frame;
+            if (g_diagnostic) {
+                stats.totalAttempts++;
+            }
+            HRESULT captureHr = capture->captureFrame(frame);
+            metrics.polls.fetch_add(1, std::memory_order_relaxed);
+
+            FlightRecord rec = {};
+            rec.timestampNs = frame.timestampNs;
+            rec.sinceInputNs = frame.timestampNs - inputTimeNs_;
+            rec.hr = static_cast<int32_t>(captureHr);
+            rec.acquireTimeUs = static_cast<int32_t>(frame.acquireTimeUs);
+            rec.accumulatedFrames = frame.accumulatedFrames;
+            rec.checksum = frame.checksum;
+            rec.sample = sampleIndex_ + 1;
+            rec.run = static_cast<uint16_t>(runNumber_);
+            rec.changedTiles = frame.changedTiles;
+            rec.mouseOnly = frame.isMouseOnlyUpdate ? 1 : 0;
+            rec.engine = static_cast<uint8_t>(index_);
+            FlightRecorderRecord(rec);
+
+            if (SUCCEEDED(captureHr)) {
+                size_t knownIntervals = pacing_.intervalsMs().size();
+                pacing_.onFrame(frame.lastPresentQpc, frame.accumulatedFrames);
+                metrics.presentedFrames.fetch_add(frame.accumulatedFrames, std::memory_order_relaxed);
+                for (size_t f = knownIntervals; f < pacing_.intervalsMs().size(); f++) {
+                    metrics.frameInterval.observe(pacing_.intervalsMs()[f]);
+                }
+                // Premières mises à jour postérieures à l'input (les images accumulées pendant
+                // l'intervalle entre échantillons sont antérieures et ignorées)
+                if (cursorStageNs == 0 && frame.cursorUpdateNs > inputTimeNs_) {
+                    cursorStageNs = frame.cursorUpdateNs - inputTimeNs_;
+                }
+                if (composedStageNs == 0 && frame.accumulatedFrames > 0 && frame.presentNs > inputTimeNs_) {
+                    composedStageNs = frame.presentNs - inputTimeNs_;
+                }
+            } else if (captureHr == DXGI_ERROR_WAIT_TIMEOUT) {
+                metrics.acquireTimeouts.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                metrics.acquireErrors.fetch_add(1, std::memory_order_relaxed);
+            }
 
-                    Sleep(1);
-                    waitCount++;
-                    if (g_showOverlay) {
-                        ProcessWindowMessages();
-                        UpdateOverlay();
+            if (FAILED(captureHr) && captureHr != DXGI_ERROR_WAIT_TIMEOUT && !flightPendingReason_) {
+                flightPendingReason_ = "acquire-error";
+                sprintf_s(flightPendingDetail_, sizeof(flightPendingDetail_), "output=%d hr=0x%08X",
+                          index_, static_cast<unsigned>(captureHr));
+            }
+
+            if (SUCCEEDED(captureHr) && roiPending) {
+                TRACE_SCOPE(PHASE_MATCH);
+                for (uint64_t m = roiPending; m; m &= m - 1) {
+                    unsigned long r;
+                    _BitScanForward64(&r, m);
+                    if (frame.roiChecksums[r] == roiBaselines_[r]) continue;
+                    int64_t roiLatencyNs = frame.timestampNs - inputTimeNs_;
+                    if (roiLatencyNs > 0 && roiLatencyNs < 500000000 && sampleIndex_ >= warmupSamples_) {
+                        roiLatencies[r].back().push_back(roiLatencyNs);
                     }
+                    roiBaselines_[r] = frame.roiChecksums[r];
+                    roiPending &= ~(1ull << r);
                 }
+            }
 
-                if (!found) {
-                    sampleCount++;
-                    g_overlaySampleCount = sampleCount;
-                    g_diagStats.exclusiveScreenDetected++;
-                    g_overlayLastError = "No screen change";
-                    g_overlayLastLatency = 0.0;
-                    
+            // Échantillon sur ROI : la région principale suit simplement l'écran
+            if (SUCCEEDED(captureHr) && targetRoi_ >= 0) baselineChecksum_ = frame.checksum;
+
+            if (SUCCEEDED(captureHr) && !result.found) {
+                bool changed;
+                {
+                    TRACE_SCOPE(PHASE_MATCH);
+                    changed = targetRoi_ < 0 ? frame.checksum != baselineChecksum_
+                                             : frame.roiChecksums[targetRoi_] != targetRoiBaseline;
+                }
+                if (changed) {
+                    TRACE_SCOPE(PHASE_REPORT);
+                    int64_t latencyNs = frame.timestampNs - inputTimeNs_;
+
+                    if (latencyNs > 0 && latencyNs < 500000000) {
+                        if (sampleIndex_ >= warmupSamples_) {
+                            results.push_back(latencyNs);
+                            metrics.recordLatency(latencyNs / 1000000.0);
+                            recordStages(frame, cursorStageNs, composedStageNs);
+                        }
+
+                        updateOutlierThreshold(results);
+                        if (outlierThresholdNs_ > 0 && latencyNs > outlierThresholdNs_ && !flightPendingReason_) {
+                            flightPendingReason_ = "outlier";
+                            sprintf_s(flightPendingDetail_, sizeof(flightPendingDetail_),
+                                      "output=%d latency_ms=%.2f threshold_ms=%.2f",
+                                      index_, latencyNs / 1000000.0, outlierThresholdNs_ / 1000000.0);
+                        }
+
+                        baselineChecksum_ = frame.checksum;
+                        if (g_diagnostic) {
+                            stats.checksumChanges++;
+                        }
+                        result.found = true;
+                        roiGraceEndNs = clock_->nowNs() + kRoiGraceFrames * 1000000000ll / capture->refreshRateHz;
+                        result.latencyNs = latencyNs;
+                        result.acquireTimeUs = frame.acquireTimeUs;
+                        result.mouseOnly = frame.isMouseOnlyUpdate;
+                    }
+                } else {
                     if (g_diagnostic) {
-                        printf("[%d/%d] No screen change detected (T/O:%d, Same:%d, Wait:%d/%d ms)\n", 
-                               sampleCount, numSamples, 
-                               g_diagStats.timeouts, g_diagStats.sameChecksum, waitCount, g_maxWaitMs);
-                    } else {
-                        printf("[%d/%d] No screen change detected\n", sampleCount, numSamples);
+                        stats.sameChecksum++;
                     }
                 }
-
-                nextInputTime = GetTickCount64() + intervalMs;
             }
 
-            Sleep(1);
-            if (g_showOverlay) {
-                ProcessWindowMessages();
-                UpdateOverlay();
+            SleepMeasured(1, scheduling, *clock_);
+            result.waitCount++;
+        }
+
+        for (uint64_t m = roiPending; m; m &= m - 1) {
+            unsigned long r;
+            _BitScanForward64(&r, m);
+            if (sampleIndex_ >= warmupSamples_) roiUnchanged[r]++;
+        }
+
+        // Écriture différée à la fin de l'échantillon : les E/S ne comptent pas dans la latence.
+        // Un seul dump par échantillon (même fenêtre de l'anneau) : no-change l'emporte
+        if (!result.found) {
+            stats.exclusiveScreenDetected++;
+            metrics.noChange.fetch_add(1, std::memory_order_relaxed);
+            char detail[192] = {};
+            sprintf_s(detail, sizeof(detail), "output=%d wait_ms=%d", index_, result.waitCount);
+            if (flightPendingReason_) {
+                // Motif écarté au profit de no-change, gardé dans l'en-tête du dump
+                size_t used = strlen(detail);
+                sprintf_s(detail + used, sizeof(detail) - used, " %s=[%s]", flightPendingReason_, flightPendingDetail_);
             }
+            FlightRecorderDump("no-change", index_, runNumber_, sampleIndex_ + 1, detail);
+        } else if (flightPendingReason_) {
+            FlightRecorderDump(flightPendingReason_, index_, runNumber_, sampleIndex_ + 1, flightPendingDetail_);
         }
+        flightPendingReason_ = nullptr;
 
-        printf("\n[RUN %d] Test completed: %zu samples collected\n\n", runNumber, g_results.size());
+        metrics.runSample.store(sampleIndex_ + 1, std::memory_order_relaxed);
+        result_ = result;
+    }
 
-        g_allResults.push_back(g_results);
+    // Seuil recalculé au premier échantillon du run puis quand la série atteint 20, 40, 80...
+    // échantillons (coût amorti constant) ; le seuil du run précédent reste valable d'ici là
+    void updateOutlierThreshold(const std::vector<int64_t>& results) {
+        if (results.size() < nextOutlierUpdate_) return;
+        nextOutlierUpdate_ = (std::max)(results.size() * 2, static_cast<size_t>(20));
+        int64_t thresholdNs = FlightOutlierThresholdNs(results, outlierScratch_);
+        if (thresholdNs > 0) outlierThresholdNs_ = thresholdNs;
+    }
 
-        if (runNumber < g_nbRun) {
-            printf("[PAUSE] Waiting %d seconds before next run...\n", g_pauseSeconds);
-            for (int i = g_pauseSeconds; i > 0; i--) {
-                printf(" %d...\n", i);
-                Sleep(1000);
-                if (g_showOverlay) {
-                    ProcessWindowMessages();
-                }
-            }
+    // Image où la région change : sa présentation, ou la mise à jour du curseur si elle est seule
+    // (curseur dans la région) ; à défaut, l'instant de la capture
+    void recordStages(const CaptureFrameInfo& frame, int64_t cursorStageNs, int64_t composedStageNs) {
+        int64_t shownNs = frame.accumulatedFrames > 0 ? frame.presentNs : frame.cursorUpdateNs;
+        if (shownNs <= inputTimeNs_) shownNs = frame.timestampNs;
+        int64_t regionStageNs = shownNs - inputTimeNs_;
+
+        stages.regionNs.push_back(regionStageNs);
+        if (cursorStageNs > 0) stages.cursorNs.push_back(cursorStageNs);
+        else stages.cursorMissing++;
+        if (composedStageNs > 0) {
+            stages.composedNs.push_back(composedStageNs);
+            stages.applicationNs.push_back((std::max)(regionStageNs - composedStageNs, static_cast<int64_t>(0)));
         }
     }
 
-    printf("\n\n========================================\n");
-    printf(" ALL RUNS COMPLETED\n");
-    printf("========================================\n");
+    int index_;
+    OutputSelection selection_;
+    Clock* clock_;
+    size_t roiCount_ = 0;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    Command command_ = Command::None;
+    std::atomic<bool> busy_{false};
+
+    // État d'échantillonnage, accédé uniquement par le thread du moteur pendant qu'il est occupé
+    int runNumber_ = 0;
+    int warmupSamples_ = 0;
+    int sampleIndex_ = 0;
+    int64_t inputTimeNs_ = 0;
+    int targetRoi_ = -1;
+    uint32_t baselineChecksum_ = 0;
+    uint32_t roiBaselines_[kMaxExtraRois] = {};
+    FramePacingAnalyzer pacing_;
+    int64_t outlierThresholdNs_ = 0;
+    size_t nextOutlierUpdate_ = 0;
+    std::vector<int64_t> outlierScratch_;
+    const char* flightPendingReason_ = nullptr;   // dump en attente de la fin de l'échantillon
+    char flightPendingDetail_[96] = {};
+    EngineSampleResult result_;
+};
 
-    PrintAverageResults();
-    PrintDiagnosticStats();
+// Liste des sorties disponibles (--list-outputs)
+void ListOutputs() {
+    ComPtr<IDXGIFactory1> factory;
+    HRESULT hr = CreateDXGIFactory1(IID_PPV_ARGS(&factory));
+    if (FAILED(hr)) {
+        printf("[DXGI] ERROR CreateDXGIFactory1 failed: 0x%X\n", hr);
+        return;
+    }
 
-    // Laisser la fenêtre affichée 5 secondes avant de fermer
-    if (g_overlayWindow) {
-        printf("\n[OVERLAY] Closing in 5 seconds...\n");
-        for (int i = 5; i > 0; i--) {
-            Sleep(1000);
-            ProcessWindowMessages();
+    printf("\n[*] Available outputs (use --output ADAPTER:OUTPUT)\n");
+    ComPtr<IDXGIAdapter1> adapter;
+    for (UINT a = 0; factory->EnumAdapters1(a, adapter.ReleaseAndGetAddressOf()) != DXGI_ERROR_NOT_FOUND; a++) {
+        DXGI_ADAPTER_DESC adapterDesc = {};
+        adapter->GetDesc(&adapterDesc);
+        char gpuName[128] = {};
+        size_t converted = 0;
+        wcstombs_s(&converted, gpuName, sizeof(gpuName), adapterDesc.Description, _TRUNCATE);
+        printf(" Adapter %u: %s\n", a, gpuName);
+
+        ComPtr<IDXGIOutput> output;
+        for (UINT o = 0; adapter->EnumOutputs(o, output.ReleaseAndGetAddressOf()) != DXGI_ERROR_NOT_FOUND; o++) {
+            DXGI_OUTPUT_DESC desc = {};
+            output->GetDesc(&desc);
+            char deviceName[64] = {};
+            wcstombs_s(&converted, deviceName, sizeof(deviceName), desc.DeviceName, _TRUNCATE);
+            DEVMODEW mode = {};
+            mode.dmSize = sizeof(mode);
+            int hz = EnumDisplaySettingsW(desc.DeviceName, ENUM_CURRENT_SETTINGS, &mode) ? (int)mode.dmDisplayFrequency : 0;
+            printf("   %u:%u  %-16s %ldx%ld at (%ld,%ld)  %d Hz\n", a, o, deviceName,
+                   desc.DesktopCoordinates.right - desc.DesktopCoordinates.left,
+                   desc.DesktopCoordinates.bottom - desc.DesktopCoordinates.top,
+                   desc.DesktopCoordinates.left, desc.DesktopCoordinates.top, hz);
         }
-        DestroyWindow(g_overlayWindow);
     }
+    printf("\n");
+}
 
-    printf("\n[+] Test completed successfully\n\n");
+// Comparaison des sorties testées simultanément
+void PrintOutputComparison(const std::vector<std::unique_ptr<CaptureEngine>>& engines) {
+    if (engines.size() < 2) return;
+
+    printf("[*] Per-Output Comparison\n");
+    for (const auto& engine : engines) {
+        std::vector<int64_t> all;
+        for (const auto& run : engine->runLatencies) all.insert(all.end(), run.begin(), run.end());
+        std::vector<double> intervals;
+        for (const auto& run : engine->frameIntervalsMs) intervals.insert(intervals.end(), run.begin(), run.end());
+        FramePacingStats pacing = ComputeFramePacingStats(intervals);
+
+        printf(" Output %d: %s @ %d Hz (%s)\n", engine->index(), engine->capture->monitorName().c_str(),
+               engine->capture->refreshRateHz, engine->capture->gpuName().c_str());
+        if (all.empty()) {
+            printf("    No latency data (%d no-change samples)\n", engine->stats.exclusiveScreenDetected);
+            continue;
+        }
+        std::sort(all.begin(), all.end());
+        size_t n = all.size();
+        int64_t sum = 0;
+        for (auto v : all) sum += v;
+        double frameTimeMs = engine->frameTimeMs();
+        printf("    Samples=%zu, P50=%.2f ms (%.2f fr), Avg=%.2f, P95=%.2f, P99=%.2f ms, No-change=%d, FPS=%.1f\n",
+               n, all[n / 2] / 1000000.0, (all[n / 2] / 1000000.0) / frameTimeMs,
+               (sum / (double)n) / 1000000.0,
+               SortedPercentile(all, 0.95) / 1000000.0,
+               SortedPercentile(all, 0.99) / 1000000.0,
+               engine->stats.exclusiveScreenDetected, pacing.avgFps);
+    }
+    printf("\n");
+}
 
-    return 0;
+static void PrintStageRow(const char* label, const std::vector<int64_t>& values, double frameTimeMs) {
+    if (values.empty()) {
+        printf(" %-36s %8d %9s %9s %9s %9s\n", label, 0, "-", "-", "-", "-");
+        return;
+    }
+    std::vector<int64_t> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    auto at = [&](double q) { return SortedPercentile(sorted, q) / 1000000.0; };
+    printf(" %-36s %8zu %9.2f %9.2f %9.2f %9.2f\n", label, n, at(0.50), at(0.95), at(0.99), at(0.50) / frameTimeMs);
+}
+
+// Latence découpée par étape : jeu (rendu + présentation) ou compositeur (attente du vsync/DWM)
+void PrintLatencyDecomposition(const std::vector<std::unique_ptr<CaptureEngine>>& engines) {
+    bool any = false;
+    for (const auto& engine : engines) any = any || !engine->stages.regionNs.empty();
+    if (!any) return;
+
+    printf("\n");
+    printf("==========================================\n");
+    printf(" LATENCY DECOMPOSITION\n");
+    printf("==========================================\n");
+    for (const auto& engine : engines) {
+        const LatencyStages& st = engine->stages;
+        if (st.regionNs.empty()) continue;
+        double frameTimeMs = engine->frameTimeMs();
+        if (engines.size() > 1) printf(" Output %d (%s)\n", engine->index(), engine->capture->monitorName().c_str());
+        printf(" %-36s %8s %9s %9s %9s %9s\n", "Stage", "Samples", "P50", "P95", "P99", "P50 fr");
+        PrintStageRow("Input -> cursor update", st.cursorNs, frameTimeMs);
+        PrintStageRow("Input -> first composed frame", st.composedNs, frameTimeMs);
+        PrintStageRow("Input -> region change presented", st.regionNs, frameTimeMs);
+        PrintStageRow("First frame -> region (application)", st.applicationNs, frameTimeMs);
+        if (st.cursorMissing > 0) {
+            printf(" Cursor update not seen before the region change: %zu sample(s)\n", st.cursorMissing);
+        }
+
+        if (!st.composedNs.empty() && !st.applicationNs.empty()) {
+            std::vector<int64_t> composed = st.composedNs;
+            std::vector<int64_t> application = st.applicationNs;
+            std::nth_element(composed.begin(), composed.begin() + composed.size() / 2, composed.end());
+            std::nth_element(application.begin(), application.begin() + application.size() / 2, application.end());
+            double composedMs = composed[composed.size() / 2] / 1000000.0;
+            double applicationMs = application[application.size() / 2] / 1000000.0;
+            printf(" -> %s dominates: %.2f ms application vs %.2f ms until the compositor presents\n",
+                   applicationMs > composedMs ? "Application (render + present queue)" : "Compositor (vsync / DWM)",
+                   applicationMs, composedMs);
+        }
+    }
+    printf("\n");
+}
+
+// Réglages appliqués et retard de réveil des Sleep(1) de chaque thread de mesure
+static void PrintSchedulingRow(const ThreadScheduling& sched) {
+    char cpu[16] = "-";
+    if (sched.cpu >= 0) sprintf_s(cpu, sizeof(cpu), "%d", sched.cpu);
+    const TracePhaseHistogram& h = sched.wakeup;
+    if (h.count == 0) {
+        printf(" %-10s %4s %-16s %7zu %9d %8s %8s %8s\n", sched.name.c_str(), cpu, sched.priority,
+               sched.lockedBytes / 1024, 0, "-", "-", "-");
+        return;
+    }
+    printf(" %-10s %4s %-16s %7zu %9llu %8.1f %8.1f %8.1f\n", sched.name.c_str(), cpu, sched.priority,
+           sched.lockedBytes / 1024, (unsigned long long)h.count,
+           HistogramPercentileNs(h, 50) / 1000.0, HistogramPercentileNs(h, 99) / 1000.0, h.maxNs / 1000.0);
+}
+
+void PrintSchedulingReport(const std::vector<std::unique_ptr<CaptureEngine>>& engines) {
+    printf("\n");
+    printf("==========================================\n");
+    printf(" THREAD SCHEDULING & WAKE-UP JITTER\n");
+    printf("==========================================\n");
+    printf(" Mode: %s, %s, %s",
+           g_realtime ? "real-time" : "default priority",
+           g_pinCpus.empty() ? "not pinned" : "pinned",
+           g_lockMemory ? "memory locked" : "pageable memory");
+    if (g_lockMemory) printf(" (+%zu KB process buffers)", g_lockedProcessBytes / 1024);
+    printf("\n Wake-up delay = time past the requested Sleep(1), in microseconds\n\n");
+    printf(" %-10s %4s %-16s %7s %9s %8s %8s %8s\n", "Thread", "CPU", "Priority", "Lck KB", "Wake-ups", "P50", "P99", "Max");
+    PrintSchedulingRow(g_inputScheduling);
+    for (const auto& engine : engines) PrintSchedulingRow(engine->scheduling);
+    printf("\n");
+}
+
+// -------- Stimuli (--stimulus) --------
+// Séquence rejouée en boucle : l'échantillon i envoie l'étape i % taille. Étapes :
+//   move[:DX]                   déplacement relatif (sans DX : alterne +dx / -dx de la session)
+//   click[:left|right|middle]   clic (appui + relâchement dans le même SendInput)
+//   key:NAME                    frappe en scancode : A-Z, 0-9, F1-F12, SPACE, ENTER, TAB, ESC,
+//                               SHIFT, CTRL, ALT, LEFT, RIGHT, UP, DOWN ou code VK 0xNN
+//   abs:X,Y                     curseur placé en X,Y (coordonnées du bureau virtuel)
+// Suffixe @NOM : l'étape est mesurée sur la ROI --roi NOM au lieu de la région principale.
+enum class StimulusKind { Move, Click, Key, Absolute };
+
+struct Stimulus {
+    StimulusKind kind = StimulusKind::Move;
+    int dx = 0;                     // Move : 0 = alterne +dx / -dx
+    DWORD buttonDown = MOUSEEVENTF_LEFTDOWN;
+    DWORD buttonUp = MOUSEEVENTF_LEFTUP;
+    WORD scanCode = 0;
+    bool extendedKey = false;
+    LONG absX = 0, absY = 0;        // Absolute : normalisés 0..65535 sur le bureau virtuel
+    int roiIndex = -1;              // -1 : région principale
+    std::string label;
+};
+
+static std::vector<Stimulus> g_stimulusSteps;                // séquence de la dernière session
+static std::vector<std::vector<int64_t>> g_stimulusResults;  // [étape][échantillon], sortie principale
+
+static bool ParseVirtualKey(const std::string& name, WORD& vk, bool& extended) {
+    static const struct { const char* name; WORD vk; bool extended; } kKeys[] = {
+        {"SPACE", VK_SPACE, false}, {"ENTER", VK_RETURN, false}, {"TAB", VK_TAB, false},
+        {"ESC", VK_ESCAPE, false}, {"SHIFT", VK_SHIFT, false}, {"CTRL", VK_CONTROL, false},
+        {"ALT", VK_MENU, false}, {"LEFT", VK_LEFT, true}, {"RIGHT", VK_RIGHT, true},
+        {"UP", VK_UP, true}, {"DOWN", VK_DOWN, true},
+    };
+    extended = false;
+    for (const auto& key : kKeys) {
+        if (_stricmp(name.c_str(), key.name) == 0) {
+            vk = key.vk;
+            extended = key.extended;
+            return true;
+        }
+    }
+    if (name.size() == 1 && isalnum(static_cast<unsigned char>(name[0]))) {
+        vk = static_cast<WORD>(toupper(static_cast<unsigned char>(name[0])));
+        return true;
+    }
+    int function = 0;
+    unsigned code = 0;
+    if ((name[0] == 'F' || name[0] == 'f') && sscanf_s(name.c_str() + 1, "%d", &function) == 1 &&
+        function >= 1 && function <= 12) {
+        vk = static_cast<WORD>(VK_F1 + function - 1);
+        return true;
+    }
+    if (name.size() > 2 && name[0] == '0' && (name[1] == 'x' || name[1] == 'X') &&
+        sscanf_s(name.c_str() + 2, "%x", &code) == 1 && code > 0 && code < 256) {
+        vk = static_cast<WORD>(code);
+        return true;
+    }
+    return false;
+}
+
+// "click:left@flash;move:30;move:-30" ; les noms de ROI doivent déjà être déclarés (--roi)
+bool ParseStimulusSequence(const std::string& spec, std::vector<Stimulus>& steps, std::string& error) {
+    steps.clear();
+    size_t pos = 0;
+    for (;;) {
+        size_t semi = spec.find(';', pos);
+        std::string item = TrimString(spec.substr(pos, semi == std::string::npos ? std::string::npos : semi - pos));
+        if (!item.empty()) {
+            Stimulus st;
+            st.label = item;
+            size_t at = item.find('@');
+            if (at != std::string::npos) {
+                std::string roiName = item.substr(at + 1);
+                item = item.substr(0, at);
+                for (size_t r = 0; r < g_extraRois.size(); r++) {
+                    if (g_extraRois[r].name == roiName) st.roiIndex = static_cast<int>(r);
+                }
+                if (st.roiIndex < 0) {
+                    error = "unknown ROI '" + roiName + "' (declare it with --roi)";
+                    return false;
+                }
+            }
+
+            size_t colon = item.find(':');
+            std::string kind = item.substr(0, colon);
+            std::string arg = colon == std::string::npos ? "" : item.substr(colon + 1);
+            if (kind == "move") {
+                st.kind = StimulusKind::Move;
+                st.dx = atoi(arg.c_str());
+                if (!arg.empty() && st.dx == 0) {
+                    error = "move expects a non-zero DX: " + st.label;
+                    return false;
+                }
+            } else if (kind == "click") {
+                st.kind = StimulusKind::Click;
+                if (arg == "right") {
+                    st.buttonDown = MOUSEEVENTF_RIGHTDOWN;
+                    st.buttonUp = MOUSEEVENTF_RIGHTUP;
+                } else if (arg == "middle") {
+                    st.buttonDown = MOUSEEVENTF_MIDDLEDOWN;
+                    st.buttonUp = MOUSEEVENTF_MIDDLEUP;
+                } else if (!arg.empty() && arg != "left") {
+                    error = "click expects left, right or middle: " + st.label;
+                    return false;
+                }
+            } else if (kind == "key") {
+                st.kind = StimulusKind::Key;
+                WORD vk = 0;
+                if (arg.empty() || !ParseVirtualKey(arg, vk, st.extendedKey)) {
+                    error = "unknown key: " + st.label;
+                    return false;
+                }
+                st.scanCode = static_cast<WORD>(MapVirtualKeyA(vk, MAPVK_VK_TO_VSC));
+                if (st.scanCode == 0) {
+                    error = "key has no scancode on this layout: " + st.label;
+                    return false;
+                }
+            } else if (kind == "abs") {
+                st.kind = StimulusKind::Absolute;
+                int x = 0, y = 0;
+                if (sscanf_s(arg.c_str(), "%d,%d", &x, &y) != 2) {
+                    error = "abs expects X,Y: " + st.label;
+                    return false;
+                }
+                int vw = GetSystemMetrics(SM_CXVIRTUALSCREEN), vh = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+                st.absX = static_cast<LONG>((x - GetSystemMetrics(SM_XVIRTUALSCREEN)) * 65535LL / (vw > 1 ? vw - 1 : 1));
+                st.absY = static_cast<LONG>((y - GetSystemMetrics(SM_YVIRTUALSCREEN)) * 65535LL / (vh > 1 ? vh - 1 : 1));
+            } else {
+                error = "unknown stimulus '" + kind + "' (move, click, key, abs)";
+                return false;
+            }
+            steps.push_back(st);
+        }
+        if (semi == std::string::npos) break;
+        pos = semi + 1;
+    }
+    if (steps.empty()) {
+        error = "empty stimulus sequence";
+        return false;
+    }
+    return true;
+}
+
+// Remplit inputs[0..1] pour SendInput ; retourne le nombre d'événements.
+// occurrence = rang de ce passage sur l'étape : un move sans dx alterne de sens à chaque passage,
+// même quand la séquence a une longueur paire
+UINT BuildStimulusInputs(const Stimulus& st, int occurrence, int sessionDx, INPUT* inputs) {
+    inputs[0] = {};
+    inputs[1] = {};
+    switch (st.kind) {
+        case StimulusKind::Move:
+            inputs[0].type = INPUT_MOUSE;
+            inputs[0].mi.dx = st.dx != 0 ? st.dx : (occurrence % 2 == 0 ? sessionDx : -sessionDx);
+            inputs[0].mi.dwFlags = MOUSEEVENTF_MOVE;
+            return 1;
+        case StimulusKind::Absolute:
+            inputs[0].type = INPUT_MOUSE;
+            inputs[0].mi.dx = st.absX;
+            inputs[0].mi.dy = st.absY;
+            inputs[0].mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK;
+            return 1;
+        case StimulusKind::Click:
+            inputs[0].type = INPUT_MOUSE;
+            inputs[0].mi.dwFlags = st.buttonDown;
+            inputs[1].type = INPUT_MOUSE;
+            inputs[1].mi.dwFlags = st.buttonUp;
+            return 2;
+        case StimulusKind::Key: {
+            DWORD flags = KEYEVENTF_SCANCODE | (st.extendedKey ? KEYEVENTF_EXTENDEDKEY : 0);
+            inputs[0].type = INPUT_KEYBOARD;
+            inputs[0].ki.wScan = st.scanCode;
+            inputs[0].ki.dwFlags = flags;
+            inputs[1] = inputs[0];
+            inputs[1].ki.dwFlags = flags | KEYEVENTF_KEYUP;
+            return 2;
+        }
+    }
+    return 0;
+}
+
+// Latences par étape de la séquence (sortie principale), si elle ne se résume pas au move par défaut
+void PrintStimulusBreakdown(double frameTimeMs) {
+    if (g_stimulusSteps.size() < 2 && (g_stimulusSteps.empty() || g_stimulusSteps[0].label == "move")) return;
+
+    printf("\n");
+    printf("==========================================\n");
+    printf(" LATENCY PER STIMULUS\n");
+    printf("==========================================\n");
+    printf(" %-24s %-12s %8s %9s %9s %9s %9s\n", "Stimulus", "Measured on", "Samples", "P50", "P95", "P99", "P50 fr");
+    for (size_t i = 0; i < g_stimulusSteps.size(); i++) {
+        const Stimulus& st = g_stimulusSteps[i];
+        const char* target = st.roiIndex < 0 ? "region" : g_extraRois[st.roiIndex].name.c_str();
+        std::vector<int64_t> sorted = g_stimulusResults[i];
+        if (sorted.empty()) {
+            printf(" %-24s %-12s %8d %9s %9s %9s %9s\n", st.label.c_str(), target, 0, "-", "-", "-", "-");
+            continue;
+        }
+        std::sort(sorted.begin(), sorted.end());
+        size_t n = sorted.size();
+        auto at = [&](double q) { return SortedPercentile(sorted, q) / 1000000.0; };
+        printf(" %-24s %-12s %8zu %9.2f %9.2f %9.2f %9.2f\n", st.label.c_str(), target, n,
+               at(0.50), at(0.95), at(0.99), at(0.50) / frameTimeMs);
+    }
+    printf("\n");
+}
+
+// -------- Session de mesure : cfg.nbRun runs sur les moteurs déjà initialisés --------
+// Notifications de progression (serveur de contrôle) ; appelées sur le thread de la session
+class SessionObserver {
+public:
+    virtual ~SessionObserver() {}
+    virtual void onRunStart(int runNumber, int totalRuns) { (void)runNumber; (void)totalRuns; }
+    virtual void onSample(int runNumber, int sampleCount, const std::vector<std::unique_ptr<CaptureEngine>>& engines) {
+        (void)runNumber; (void)sampleCount; (void)engines;
+    }
+    virtual void onRunEnd(int runNumber, const std::vector<int64_t>& latencies) { (void)runNumber; (void)latencies; }
+};
+
+struct SessionConfig {
+    int numSamples = 210;
+    int warmupSamples = 10;
+    int intervalMs = 50;
+    int dx = 30;
+    int nbRun = 3;
+    int pauseSeconds = 3;
+    int startDelayMs = 3000;   // délai pour revenir au jeu avant chaque run
+    std::vector<Stimulus> stimuli;   // vide : move alterné +dx / -dx
+    SessionObserver* observer = nullptr;
+};
+
+// Applique la même région à tous les moteurs ; x / y à kRegionCentered : chaque backend
+// centre la région sur son propre écran
+void ApplyRegionToEngines(std::vector<std::unique_ptr<CaptureEngine>>& engines, int x, int y, int w, int h) {
+    for (auto& engine : engines) {
+        engine->capture->setRegion(x, y, w, h);
+    }
+}
+
+// Retourne false si la session a été interrompue (g_abortRequested)
+bool RunMeasurementSession(std::vector<std::unique_ptr<CaptureEngine>>& engines, const SessionConfig& cfg) {
+    CaptureEngine& primary = *engines.front();
+    double frameTimeMs = primary.frameTimeMs();
+    int numSamples = cfg.numSamples;
+    int warmupSamples = cfg.warmupSamples;
+    int intervalMs = cfg.intervalMs;
+    int dx = cfg.dx;
+
+    // Horloge virtuelle : les moteurs sont exécutés sur ce thread, seul à faire avancer le temps
+    Clock& clock = *g_clock;
+    bool inlineEngines = !clock.realTime();
+
+    g_overlayTotalRuns = cfg.nbRun;
+    g_overlayTotalSamples = numSamples;
+    g_stimulusSteps = cfg.stimuli;
+    if (g_stimulusSteps.empty()) {
+        Stimulus move;
+        move.label = "move";
+        g_stimulusSteps.push_back(move);
+    }
+    g_stimulusResults.assign(g_stimulusSteps.size(), {});
+    g_allResults.clear();
+    g_allFrameIntervalsMs.clear();
+    g_flightDumpsWritten.store(0);   // limite de dumps par session (--serve, --sweep)
+    for (auto& engine : engines) {
+        engine->resetResults();
+    }
+
+    for (int runNumber = 1; runNumber <= cfg.nbRun; runNumber++) {
+        g_overlayCurrentRun = runNumber;
+        g_overlaySampleCount = 0;
+        g_overlayLastError = "";
+        UpdateOverlay();
+
+        printf("\n===============================================\n");
+        printf(" RUN %d / %d\n", runNumber, cfg.nbRun);
+        printf("===============================================\n\n");
+
+        if (cfg.startDelayMs > 0) {
+            printf("[OK] Starting test in %.1f seconds...\n", cfg.startDelayMs / 1000.0);
+            clock.sleepMs(cfg.startDelayMs);
+        }
+        printf("[OK] Measurements starting...\n\n");
+
+        int sampleCount = 0;
+        int64_t nextInputNs = clock.nowNs() + intervalMs * 1000000ll;
+
+        for (auto& engine : engines) {
+            if (inlineEngines) {
+                engine->prepareRun(runNumber, numSamples, warmupSamples);
+                engine->measureBaseline();
+            } else {
+                engine->beginRun(runNumber, numSamples, warmupSamples);
+            }
+        }
+        if (cfg.observer) cfg.observer->onRunStart(runNumber, cfg.nbRun);
+
+        while (sampleCount < numSamples && !g_abortRequested.load()) {
+            if (clock.nowNs() >= nextInputNs) {
+                size_t step = static_cast<size_t>(sampleCount) % g_stimulusSteps.size();
+                const Stimulus& stimulus = g_stimulusSteps[step];
+                INPUT inputs[2];
+                int occurrence = static_cast<int>(static_cast<size_t>(sampleCount) / g_stimulusSteps.size());
+                UINT inputCount = BuildStimulusInputs(stimulus, occurrence, dx, inputs);
+
+                int64_t inputTimeNs = clock.nowNs();
+
+                if (!g_synthetic.enabled) {
+                    TRACE_SCOPE(PHASE_INPUT_SEND);
+                    SendInput(inputCount, inputs, sizeof(INPUT));
+                }
+
+                for (auto& engine : engines) {
+                    if (inlineEngines) engine->measureSample(sampleCount, inputTimeNs, stimulus.roiIndex);
+                    else engine->armSample(sampleCount, inputTimeNs, stimulus.roiIndex);
+                }
+
+                // Attente de tous les moteurs ; l'overlay reste traité par ce thread
+                while (!inlineEngines) {
+                    bool anyBusy = false;
+                    for (const auto& engine : engines) anyBusy = anyBusy || engine->busy();
+                    if (!anyBusy) break;
+                    SleepMeasured(1, g_inputScheduling);
+                    if (g_showOverlay) {
+                        ProcessWindowMessages();
+                        UpdateOverlay();
+                    }
+                }
+
+                TRACE_SCOPE(PHASE_REPORT);
+                sampleCount++;
+                g_overlaySampleCount = sampleCount;
+
+                const EngineSampleResult& mainSample = primary.sampleResult();
+                if (mainSample.found && sampleCount > warmupSamples) {
+                    g_stimulusResults[step].push_back(mainSample.latencyNs);
+                }
+                if (mainSample.found) {
+                    g_overlayLastLatency = mainSample.latencyNs / 1000000.0;
+                    g_overlayLastError = "";
+                } else {
+                    g_overlayLastError = "No screen change";
+                    g_overlayLastLatency = 0.0;
+                }
+
+                if (engines.size() == 1) {
+                    if (mainSample.found) {
+                        double latencyMs = mainSample.latencyNs / 1000000.0;
+                        double frames = latencyMs / frameTimeMs;
+                        if (g_verbose) {
+                            if (g_diagnostic) {
+                                printf("[%d/%d] Latency: %.2f ms (%.2f frames) [AcquireTime: %lld µs%s]\n",
+                                       sampleCount, numSamples, latencyMs, frames, 
+                                       (long long)mainSample.acquireTimeUs,
+                                       mainSample.mouseOnly ? ", MouseOnly" : "");
+                            } else {
+                                printf("[%d/%d] Latency: %.2f ms (%.2f frames)\n",
+                                       sampleCount, numSamples, latencyMs, frames);
+                            }
+                        }
+                    } else if (g_diagnostic) {
+                        printf("[%d/%d] No screen change detected (T/O:%d, Same:%d, Wait:%d/%d ms)\n", 
+                               sampleCount, numSamples, 
+                               primary.stats.timeouts, primary.stats.sameChecksum, mainSample.waitCount, g_maxWaitMs);
+                    } else {
+                        printf("[%d/%d] No screen change detected\n", sampleCount, numSamples);
+                    }
+                } else {
+                    bool anyMissed = false;
+                    for (const auto& engine : engines) anyMissed = anyMissed || !engine->sampleResult().found;
+                    if (g_verbose || anyMissed) {
+                        printf("[%d/%d]", sampleCount, numSamples);
+                        for (const auto& engine : engines) {
+                            const EngineSampleResult& r = engine->sampleResult();
+                            if (r.found) {
+                                double latencyMs = r.latencyNs / 1000000.0;
+                                printf(" OUT%d: %.2f ms (%.2f fr)", engine->index(), latencyMs,
+                                       latencyMs / engine->frameTimeMs());
+                            } else {
+                                printf(" OUT%d: no change", engine->index());
+                            }
+                        }
+                        printf("\n");
+                    }
+                }
+
+                if (cfg.observer) cfg.observer->onSample(runNumber, sampleCount, engines);
+
+                nextInputNs = clock.nowNs() + intervalMs * 1000000ll;
+            }
+
+            SleepMeasured(1, g_inputScheduling);
+            if (g_showOverlay) {
+                ProcessWindowMessages();
+                UpdateOverlay();
+            }
+        }
+
+        for (auto& engine : engines) {
+            engine->endRun();
+        }
+        g_results = primary.runLatencies.back();
+
+        printf("\n[RUN %d] Test completed: %zu samples collected\n\n", runNumber, g_results.size());
+
+        g_allResults.push_back(g_results);
+        g_allFrameIntervalsMs.push_back(primary.frameIntervalsMs.back());
+        if (cfg.observer) cfg.observer->onRunEnd(runNumber, g_results);
+
+        if (g_abortRequested.load()) {
+            printf("[ABORT] Session aborted during run %d\n", runNumber);
+            break;
+        }
+
+        if (runNumber < cfg.nbRun) {
+            printf("[PAUSE] Waiting %d seconds before next run...\n", cfg.pauseSeconds);
+            for (int i = cfg.pauseSeconds; i > 0 && !g_abortRequested.load(); i--) {
+                printf(" %d...\n", i);
+                clock.sleepMs(1000);
+                if (g_showOverlay) {
+                    UpdateOverlay();
+                    ProcessWindowMessages();
+                }
+            }
+        }
+    }
+
+    g_pacingCoalescedFrames = primary.coalescedFrames;
+    g_roiResults = primary.roiLatencies;
+    g_roiUnchanged = primary.roiUnchanged;
+    return !g_abortRequested.load();
+}
+
+// -------- Historique local des résultats (--store DIR) --------
+// Magasin append-only en colonnes : une colonne = un fichier binaire à largeur fixe (col_*.bin),
+// la ligne N est à l'offset N * largeur. rows.count est réécrit en dernier : seules les lignes
+// validées sont lues, une session interrompue est simplement réécrite au prochain ajout.
+// fingerprints.tsv / tags.tsv sont les dictionnaires ; idx\fp_<id>.rows liste les lignes
+// de chaque empreinte matérielle (index inversé, lu sans parcourir toute la table).
+struct HardwareFingerprint {
+    std::string cpu, gpu, driver, bios, monitor;
+    int monitorHz = 0;
+};
+
+struct StoredSession {
+    int64_t timestamp = 0;
+    uint32_t fingerprintId = 0;
+    uint32_t tagId = 0;
+    uint32_t samples = 0;
+    int64_t minNs = 0, p50Ns = 0, avgNs = 0, p95Ns = 0, p99Ns = 0, maxNs = 0;
+    double stdDevNs = 0.0;
+    double avgFps = 0.0;
+};
+
+class ResultsStore {
+public:
+    bool open(const std::string& dir) {
+        dir_ = dir;
+        if (!dir_.empty() && dir_.back() != '\\' && dir_.back() != '/') dir_ += '\\';
+        if (!ensureDirectory(dir_) || !ensureDirectory(dir_ + "idx\\")) {
+            printf("[STORE] ERROR Could not create store directory %s\n", dir_.c_str());
+            return false;
+        }
+        loadDictionaries();
+        rowCount_ = readRowCount();
+        return true;
+    }
+
+    // Ajoute une session ; retourne le numéro de ligne ou -1
+    int64_t append(const HardwareFingerprint& fp, const std::string& tag, const StoredSession& session) {
+        StoredSession row = session;
+        row.fingerprintId = internFingerprint(fp);
+        row.tagId = internTag(tag);
+        if (row.fingerprintId == kInvalidId || row.tagId == kInvalidId) return -1;
+
+        uint64_t r = rowCount_;
+        bool ok = writeColumn("time", r, &row.timestamp, sizeof(row.timestamp))
+               && writeColumn("fingerprint", r, &row.fingerprintId, sizeof(row.fingerprintId))
+               && writeColumn("tag", r, &row.tagId, sizeof(row.tagId))
+               && writeColumn("samples", r, &row.samples, sizeof(row.samples))
+               && writeColumn("min", r, &row.minNs, sizeof(row.minNs))
+               && writeColumn("p50", r, &row.p50Ns, sizeof(row.p50Ns))
+               && writeColumn("avg", r, &row.avgNs, sizeof(row.avgNs))
+               && writeColumn("p95", r, &row.p95Ns, sizeof(row.p95Ns))
+               && writeColumn("p99", r, &row.p99Ns, sizeof(row.p99Ns))
+               && writeColumn("max", r, &row.maxNs, sizeof(row.maxNs))
+               && writeColumn("stddev", r, &row.stdDevNs, sizeof(row.stdDevNs))
+               && writeColumn("fps", r, &row.avgFps, sizeof(row.avgFps))
+               && appendIndex(row.fingerprintId, static_cast<uint32_t>(r))
+               && writeRowCount(r + 1);
+        if (!ok) {
+            printf("[STORE] ERROR Could not append session to %s\n", dir_.c_str());
+            return -1;
+        }
+        rowCount_ = r + 1;
+        return static_cast<int64_t>(r);
+    }
+
+    // Sessions d'un GPU (toutes versions de pilote), triées par date ; tag vide = tous
+    std::vector<StoredSession> queryGpu(const std::string& gpu, const std::string& tag) const {
+        std::vector<StoredSession> out;
+        uint32_t tagId = kInvalidId;
+        if (!tag.empty()) {
+            for (size_t t = 0; t < tags_.size(); t++) {
+                if (tags_[t] == tag) tagId = static_cast<uint32_t>(t);
+            }
+            if (tagId == kInvalidId) return out;
+        }
+
+        std::vector<uint32_t> rows;
+        std::vector<uint32_t> rowFingerprints;
+        for (size_t f = 0; f < fingerprints_.size(); f++) {
+            if (fingerprints_[f].gpu != gpu) continue;
+            for (uint32_t r : readIndex(static_cast<uint32_t>(f))) {
+                rows.push_back(r);
+                rowFingerprints.push_back(static_cast<uint32_t>(f));
+            }
+        }
+
+        std::vector<StoredSession> sessions;
+        std::vector<char> valid;
+        readRows(rows, sessions, valid);
+        for (size_t i = 0; i < sessions.size(); i++) {
+            const StoredSession& s = sessions[i];
+            if (!valid[i] || s.fingerprintId != rowFingerprints[i]) continue;   // entrée d'index orpheline
+            if (tagId != kInvalidId && s.tagId != tagId) continue;
+            out.push_back(s);
+        }
+        std::sort(out.begin(), out.end(),
+                  [](const StoredSession& a, const StoredSession& b) { return a.timestamp < b.timestamp; });
+        return out;
+    }
+
+    const HardwareFingerprint& fingerprint(uint32_t id) const { return fingerprints_[id]; }
+    const std::string& tagName(uint32_t id) const { return tags_[id]; }
+    uint64_t rowCount() const { return rowCount_; }
+    const std::string& directory() const { return dir_; }
+
+private:
+    static const uint32_t kInvalidId = 0xFFFFFFFFu;
+
+    static bool ensureDirectory(const std::string& path) {
+        return CreateDirectoryA(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+    }
+
+    static std::string sanitize(const std::string& value) {
+        std::string out = value;
+        for (char& c : out) {
+            if (c == '\t' || c == '\n' || c == '\r') c = ' ';
+        }
+        return out;
+    }
+
+    static bool splitTabs(const char* line, std::vector<std::string>& fields) {
+        fields.clear();
+        std::string text = line;
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) text.pop_back();
+        size_t pos = 0;
+        for (;;) {
+            size_t tab = text.find('\t', pos);
+            fields.push_back(text.substr(pos, tab == std::string::npos ? std::string::npos : tab - pos));
+            if (tab == std::string::npos) break;
+            pos = tab + 1;
+        }
+        return !fields.empty();
+    }
+
+    // Les dictionnaires sont indexés par position : la ligne i porte l'identifiant i
+    void loadDictionaries() {
+        fingerprints_.clear();
+        tags_.clear();
+        char line[1024];
+        std::vector<std::string> fields;
+
+        FILE* f = nullptr;
+        if (fopen_s(&f, (dir_ + "fingerprints.tsv").c_str(), "r") == 0 && f) {
+            while (fgets(line, sizeof(line), f)) {
+                if (!splitTabs(line, fields) || fields.size() < 6) continue;
+                HardwareFingerprint fp;
+                fp.cpu = fields[0];
+                fp.gpu = fields[1];
+                fp.driver = fields[2];
+                fp.bios = fields[3];
+                fp.monitor = fields[4];
+                fp.monitorHz = atoi(fields[5].c_str());
+                fingerprints_.push_back(fp);
+            }
+            fclose(f);
+        }
+
+        if (fopen_s(&f, (dir_ + "tags.tsv").c_str(), "r") == 0 && f) {
+            while (fgets(line, sizeof(line), f)) {
+                if (!splitTabs(line, fields)) continue;
+                tags_.push_back(fields[0]);
+            }
+            fclose(f);
+        }
+    }
+
+    uint32_t internFingerprint(const HardwareFingerprint& raw) {
+        HardwareFingerprint fp = raw;
+        fp.cpu = sanitize(fp.cpu);
+        fp.gpu = sanitize(fp.gpu);
+        fp.driver = sanitize(fp.driver);
+        fp.bios = sanitize(fp.bios);
+        fp.monitor = sanitize(fp.monitor);
+        for (size_t i = 0; i < fingerprints_.size(); i++) {
+            const HardwareFingerprint& e = fingerprints_[i];
+            if (e.cpu == fp.cpu && e.gpu == fp.gpu && e.driver == fp.driver && e.bios == fp.bios &&
+                e.monitor == fp.monitor && e.monitorHz == fp.monitorHz) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+
+        FILE* f = nullptr;
+        if (fopen_s(&f, (dir_ + "fingerprints.tsv").c_str(), "a") != 0 || !f) return kInvalidId;
+        fprintf(f, "%s\t%s\t%s\t%s\t%s\t%d\n", fp.cpu.c_str(), fp.gpu.c_str(), fp.driver.c_str(),
+                fp.bios.c_str(), fp.monitor.c_str(), fp.monitorHz);
+        fclose(f);
+        fingerprints_.push_back(fp);
+        return static_cast<uint32_t>(fingerprints_.size() - 1);
+    }
+
+    uint32_t internTag(const std::string& raw) {
+        std::string tag = sanitize(raw);
+        for (size_t i = 0; i < tags_.size(); i++) {
+            if (tags_[i] == tag) return static_cast<uint32_t>(i);
+        }
+
+        FILE* f = nullptr;
+        if (fopen_s(&f, (dir_ + "tags.tsv").c_str(), "a") != 0 || !f) return kInvalidId;
+        fprintf(f, "%s\n", tag.c_str());
+        fclose(f);
+        tags_.push_back(tag);
+        return static_cast<uint32_t>(tags_.size() - 1);
+    }
+
+    std::string columnPath(const char* column) const {
+        return dir_ + "col_" + column + ".bin";
+    }
+
+    bool writeColumn(const char* column, uint64_t row, const void* value, size_t width) const {
+        std::string path = columnPath(column);
+        FILE* f = nullptr;
+        if (fopen_s(&f, path.c_str(), "r+b") != 0 || !f) {
+            if (fopen_s(&f, path.c_str(), "w+b") != 0 || !f) return false;
+        }
+        bool ok = _fseeki64(f, static_cast<int64_t>(row * width), SEEK_SET) == 0
+               && fwrite(value, width, 1, f) == 1;
+        fclose(f);
+        return ok;
+    }
+
+    // Lecture colonne par colonne : chaque fichier de colonne est ouvert une seule fois par requête
+    // et parcouru dans l'ordre des lignes ; valid[i] est faux si la ligne i est illisible
+    void readRows(const std::vector<uint32_t>& rows, std::vector<StoredSession>& out, std::vector<char>& valid) const {
+        out.assign(rows.size(), StoredSession());
+        valid.assign(rows.size(), 1);
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (rows[i] >= rowCount_) valid[i] = 0;
+        }
+        readColumnRows("time", rows, out, valid, &StoredSession::timestamp);
+        readColumnRows("fingerprint", rows, out, valid, &StoredSession::fingerprintId);
+        readColumnRows("tag", rows, out, valid, &StoredSession::tagId);
+        readColumnRows("samples", rows, out, valid, &StoredSession::samples);
+        readColumnRows("min", rows, out, valid, &StoredSession::minNs);
+        readColumnRows("p50", rows, out, valid, &StoredSession::p50Ns);
+        readColumnRows("avg", rows, out, valid, &StoredSession::avgNs);
+        readColumnRows("p95", rows, out, valid, &StoredSession::p95Ns);
+        readColumnRows("p99", rows, out, valid, &StoredSession::p99Ns);
+        readColumnRows("max", rows, out, valid, &StoredSession::maxNs);
+        readColumnRows("stddev", rows, out, valid, &StoredSession::stdDevNs);
+        readColumnRows("fps", rows, out, valid, &StoredSession::avgFps);
+        for (size_t i = 0; i < out.size(); i++) {
+            if (out[i].fingerprintId >= fingerprints_.size() || out[i].tagId >= tags_.size()) valid[i] = 0;
+        }
+    }
+
+    template <typename T>
+    void readColumnRows(const char* column, const std::vector<uint32_t>& rows, std::vector<StoredSession>& out,
+                        std::vector<char>& valid, T StoredSession::* field) const {
+        FILE* f = nullptr;
+        if (fopen_s(&f, columnPath(column).c_str(), "rb") != 0 || !f) {
+            valid.assign(valid.size(), 0);
+            return;
+        }
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (!valid[i]) continue;
+            if (_fseeki64(f, static_cast<int64_t>(rows[i]) * sizeof(T), SEEK_SET) != 0 ||
+                fread(&(out[i].*field), sizeof(T), 1, f) != 1) {
+                valid[i] = 0;
+            }
+        }
+        fclose(f);
+    }
+
+    std::string indexPath(uint32_t fingerprintId) const {
+        char name[32] = {};
+        sprintf_s(name, sizeof(name), "idx\\fp_%u.rows", fingerprintId);
+        return dir_ + name;
+    }
+
+    bool appendIndex(uint32_t fingerprintId, uint32_t row) const {
+        FILE* f = nullptr;
+        if (fopen_s(&f, indexPath(fingerprintId).c_str(), "ab") != 0 || !f) return false;
+        bool ok = fwrite(&row, sizeof(row), 1, f) == 1;
+        fclose(f);
+        return ok;
+    }
+
+    std::vector<uint32_t> readIndex(uint32_t fingerprintId) const {
+        std::vector<uint32_t> rows;
+        FILE* f = nullptr;
+        if (fopen_s(&f, indexPath(fingerprintId).c_str(), "rb") != 0 || !f) return rows;
+        uint32_t row = 0;
+        while (fread(&row, sizeof(row), 1, f) == 1) {
+            if (row < rowCount_ && (rows.empty() || rows.back() != row)) rows.push_back(row);
+        }
+        fclose(f);
+        return rows;
+    }
+
+    uint64_t readRowCount() const {
+        FILE* f = nullptr;
+        if (fopen_s(&f, (dir_ + "rows.count").c_str(), "r") != 0 || !f) return 0;
+        unsigned long long count = 0;
+        if (fscanf_s(f, "%llu", &count) != 1) count = 0;
+        fclose(f);
+        return count;
+    }
+
+    bool writeRowCount(uint64_t count) const {
+        std::string tmp = dir_ + "rows.count.tmp";
+        FILE* f = nullptr;
+        if (fopen_s(&f, tmp.c_str(), "w") != 0 || !f) return false;
+        fprintf(f, "%llu\n", (unsigned long long)count);
+        fclose(f);
+        return MoveFileExA(tmp.c_str(), (dir_ + "rows.count").c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+    }
+
+    std::string dir_;
+    uint64_t rowCount_ = 0;
+    std::vector<HardwareFingerprint> fingerprints_;
+    std::vector<std::string> tags_;
+};
+
+HardwareFingerprint CurrentHardwareFingerprint() {
+    HardwareFingerprint fp;
+    fp.cpu = g_cpuName;
+    fp.gpu = g_gpuName;
+    fp.driver = g_gpuDriverVersion;
+    fp.bios = g_biosVersion;
+    fp.monitor = g_monitorName;
+    fp.monitorHz = g_monitorHz;
+    return fp;
+}
+
+// Ajoute la session courante (g_allResults / g_allFrameIntervalsMs) au magasin
+void StoreSessionResults(const std::string& tag) {
+    if (g_storeDir.empty() || g_synthetic.enabled) return;
+
+    std::vector<int64_t> latencies;
+    for (const auto& run : g_allResults) latencies.insert(latencies.end(), run.begin(), run.end());
+    std::vector<double> intervals;
+    for (const auto& run : g_allFrameIntervalsMs) intervals.insert(intervals.end(), run.begin(), run.end());
+    if (latencies.empty()) {
+        printf("[STORE] No latency samples, session not stored\n");
+        return;
+    }
+
+    LatencySummary summary = ComputeLatencySummary(latencies);
+    StoredSession s;
+    s.timestamp = static_cast<int64_t>(time(nullptr));
+    s.samples = static_cast<uint32_t>(summary.samples);
+    s.minNs = summary.minNs;
+    s.p50Ns = summary.p50Ns;
+    s.avgNs = summary.avgNs;
+    s.p95Ns = summary.p95Ns;
+    s.p99Ns = summary.p99Ns;
+    s.maxNs = summary.maxNs;
+    s.stdDevNs = summary.stdDevNs;
+    s.avgFps = ComputeFramePacingStats(intervals).avgFps;
+
+    ResultsStore store;
+    if (!store.open(g_storeDir)) return;
+    int64_t row = store.append(CurrentHardwareFingerprint(), tag, s);
+    if (row >= 0) {
+        printf("[STORE] Session #%lld stored in %s (tag: %s)\n", (long long)row, store.directory().c_str(),
+               tag.empty() ? "-" : tag.c_str());
+    }
+}
+
+// Historique P50/P95/P99 de ce GPU, toutes versions de pilote confondues (--history)
+void PrintResultsHistory(const std::string& gpu, const std::string& tag) {
+    ResultsStore store;
+    if (!store.open(g_storeDir)) return;
+
+    std::vector<StoredSession> sessions = store.queryGpu(gpu, tag);
+    printf("\n[*] Results history for %s%s%s (%zu of %llu stored sessions)\n", gpu.c_str(),
+           tag.empty() ? "" : ", tag ", tag.c_str(), sessions.size(), (unsigned long long)store.rowCount());
+    if (sessions.empty()) {
+        printf("    No sessions recorded in %s\n\n", store.directory().c_str());
+        return;
+    }
+
+    printf("    %-16s %-16s %-24s %7s %8s %8s %8s %7s\n",
+           "Date", "Driver", "Tag", "Samples", "P50", "P95", "P99", "FPS");
+    for (const StoredSession& s : sessions) {
+        time_t t = static_cast<time_t>(s.timestamp);
+        struct tm local = {};
+        localtime_s(&local, &t);
+        char date[32] = {};
+        sprintf_s(date, sizeof(date), "%04d-%02d-%02d %02d:%02d", local.tm_year + 1900, local.tm_mon + 1,
+                  local.tm_mday, local.tm_hour, local.tm_min);
+        printf("    %-16s %-16.16s %-24.24s %7u %8.2f %8.2f %8.2f %7.1f\n", date,
+               store.fingerprint(s.fingerprintId).driver.c_str(), store.tagName(s.tagId).c_str(), s.samples,
+               s.p50Ns / 1000000.0, s.p95Ns / 1000000.0, s.p99Ns / 1000000.0, s.avgFps);
+    }
+
+    // Synthèse par version de pilote, dans l'ordre de première apparition
+    std::vector<std::string> drivers;
+    for (const StoredSession& s : sessions) {
+        const std::string& d = store.fingerprint(s.fingerprintId).driver;
+        if (std::find(drivers.begin(), drivers.end(), d) == drivers.end()) drivers.push_back(d);
+    }
+    printf("\n    P95 by driver version:\n");
+    for (const std::string& d : drivers) {
+        std::vector<int64_t> p95;
+        for (const StoredSession& s : sessions) {
+            if (store.fingerprint(s.fingerprintId).driver == d) p95.push_back(s.p95Ns);
+        }
+        std::sort(p95.begin(), p95.end());
+        printf("    %-16s sessions=%zu  median P95=%.2f ms  best=%.2f ms  worst=%.2f ms\n", d.c_str(), p95.size(),
+               p95[p95.size() / 2] / 1000000.0, p95.front() / 1000000.0, p95.back() / 1000000.0);
+    }
+    printf("\n");
+}
+
+// Nom du GPU sans ouvrir de session de capture (utilisé par --history)
+std::string GetAdapterName(int adapterIndex) {
+    ComPtr<IDXGIFactory1> factory;
+    if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory)))) return "";
+    ComPtr<IDXGIAdapter1> adapter;
+    if (FAILED(factory->EnumAdapters1(adapterIndex < 0 ? 0 : adapterIndex, adapter.GetAddressOf()))) return "";
+    DXGI_ADAPTER_DESC desc = {};
+    adapter->GetDesc(&desc);
+    char name[128] = {};
+    size_t converted = 0;
+    wcstombs_s(&converted, name, sizeof(name), desc.Description, _TRUNCATE);
+    return name;
+}
+
+// -------- Porte de régression (--baseline FILE) --------
+// Le fichier de référence contient les latences brutes d'une session (--save-baseline).
+// Régression = écart significatif (test unilatéral, seuil g_gateAlpha) ET supérieur à la
+// tolérance : décalage global (Mann-Whitney U) pour P50, dépassement des P95/P99 de référence
+// (test binomial exact) pour la queue. Les échantillons sans changement détecté (latence
+// au-delà de --timeout, changement perdu) sortent des latences : la hausse de leur taux est
+// testée à part (binomial unilatéral contre le taux de référence). Code de sortie 2 en cas de régression.
+static const int kGateExitRegression = 2;
+
+static bool WriteBaselineFile(const std::string& path, const std::vector<int64_t>& latencies, int noChange) {
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "w") != 0 || !f) return false;
+    fprintf(f, "# inputlag-tester baseline\n");
+    fprintf(f, "# gpu=%s driver=%s monitor=%s hz=%d samples=%zu nochange=%d\n",
+            g_gpuName.c_str(), g_gpuDriverVersion.c_str(), g_monitorName.c_str(), g_monitorHz,
+            latencies.size(), noChange);
+    for (int64_t v : latencies) fprintf(f, "%lld\n", (long long)v);
+    return fclose(f) == 0;
+}
+
+bool SaveBaselineFile(const std::string& path, const std::vector<int64_t>& latencies, int noChange) {
+    if (!WriteBaselineFile(path, latencies, noChange)) {
+        printf("[GATE] ERROR Could not write baseline %s\n", path.c_str());
+        return false;
+    }
+    printf("[GATE] Baseline saved: %s (%zu samples)\n", path.c_str(), latencies.size());
+    return true;
+}
+
+// noChange = -1 si l'en-tête ne contient pas nochange= (ancien fichier)
+bool LoadBaselineFile(const std::string& path, std::vector<int64_t>& latencies, std::string& description,
+                      int& noChange) {
+    noChange = -1;
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "r") != 0 || !f) {
+        printf("[GATE] ERROR Could not open baseline %s\n", path.c_str());
+        return false;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            if (strstr(line, "gpu=")) description = TrimString(line + 1);
+            const char* noChangeTag = strstr(line, "nochange=");
+            if (noChangeTag && atoi(noChangeTag + 9) >= 0) noChange = atoi(noChangeTag + 9);
+            continue;
+        }
+        long long v = 0;
+        if (sscanf_s(line, "%lld", &v) == 1 && v > 0) latencies.push_back(v);
+    }
+    fclose(f);
+
+    if (latencies.size() < 20) {
+        printf("[GATE] ERROR Baseline %s has %zu samples (need at least 20)\n", path.c_str(), latencies.size());
+        return false;
+    }
+    return true;
+}
+
+static double NormalUpperTail(double z) {
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+// p-valeur unilatérale H1 : "current" est décalé vers le haut par rapport à "baseline".
+// Approximation normale avec correction des ex-aequo (latences quantifiées au vsync).
+double MannWhitneyGreaterPValue(const std::vector<int64_t>& current, const std::vector<int64_t>& baseline) {
+    struct Tagged { int64_t v; bool isCurrent; };
+    std::vector<Tagged> all;
+    all.reserve(current.size() + baseline.size());
+    for (int64_t v : current) all.push_back({v, true});
+    for (int64_t v : baseline) all.push_back({v, false});
+    std::sort(all.begin(), all.end(), [](const Tagged& a, const Tagged& b) { return a.v < b.v; });
+
+    double n1 = static_cast<double>(current.size());
+    double n2 = static_cast<double>(baseline.size());
+    double n = n1 + n2;
+    double rankSum = 0.0;
+    double tieTerm = 0.0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].v == all[i].v) j++;
+        double avgRank = (i + 1 + j) / 2.0;
+        double t = static_cast<double>(j - i);
+        tieTerm += t * t * t - t;
+        for (size_t k = i; k < j; k++) {
+            if (all[k].isCurrent) rankSum += avgRank;
+        }
+        i = j;
+    }
+
+    double u = rankSum - n1 * (n1 + 1.0) / 2.0;
+    double mean = n1 * n2 / 2.0;
+    double variance = n1 * n2 / 12.0 * ((n + 1.0) - tieTerm / (n * (n - 1.0)));
+    if (variance <= 0.0) return 1.0;
+    return NormalUpperTail((u - mean - 0.5) / sqrt(variance));
+}
+
+// P(X >= k) pour X ~ Binomiale(n, p), sommé en log pour rester stable sur de grands n
+double BinomialUpperTail(size_t n, size_t k, double p) {
+    if (k == 0) return 1.0;
+    if (p <= 0.0) return 0.0;
+    if (p >= 1.0) return 1.0;
+    double total = 0.0;
+    for (size_t i = k; i <= n; i++) {
+        double logTerm = lgamma(n + 1.0) - lgamma(i + 1.0) - lgamma(n - i + 1.0)
+                       + i * log(p) + (n - i) * log(1.0 - p);
+        total += exp(logTerm);
+    }
+    return (std::min)(total, 1.0);
+}
+
+// Fraction des échantillons strictement au-dessus du seuil
+static double FractionAbove(const std::vector<int64_t>& values, int64_t thresholdNs, size_t& count) {
+    count = 0;
+    for (int64_t v : values) {
+        if (v > thresholdNs) count++;
+    }
+    return values.empty() ? 0.0 : count / static_cast<double>(values.size());
+}
+
+int RunRegressionGate(const std::vector<int64_t>& baseline, int baselineNoChange, const std::string& description,
+                      const std::vector<int64_t>& current, int currentNoChange) {
+    printf("\n==========================================\n");
+    printf(" REGRESSION GATE vs %s\n", g_baselinePath.c_str());
+    printf("==========================================\n\n");
+    if (!description.empty()) printf(" Baseline : %s\n", description.c_str());
+    printf(" Samples  : baseline %zu, current %zu\n", baseline.size(), current.size());
+    if (baselineNoChange >= 0) {
+        printf(" No change: baseline %d, current %d\n", baselineNoChange, currentNoChange);
+    }
+
+    if (current.size() < 20) {
+        printf(" RESULT   : ERROR, not enough current samples to compare\n\n");
+        return 1;
+    }
+
+    const char* hzTag = strstr(description.c_str(), "hz=");
+    if (hzTag && atoi(hzTag + 3) != g_monitorHz) {
+        printf(" WARNING  : baseline refresh rate %d Hz differs from current %d Hz\n", atoi(hzTag + 3), g_monitorHz);
+    }
+
+    LatencySummary base = ComputeLatencySummary(baseline);
+    LatencySummary cur = ComputeLatencySummary(current);
+
+    double locationP = MannWhitneyGreaterPValue(current, baseline);
+
+    size_t baseAbove95 = 0, curAbove95 = 0, baseAbove99 = 0, curAbove99 = 0;
+    double baseRate95 = FractionAbove(baseline, base.p95Ns, baseAbove95);
+    double curRate95 = FractionAbove(current, base.p95Ns, curAbove95);
+    double baseRate99 = FractionAbove(baseline, base.p99Ns, baseAbove99);
+    double curRate99 = FractionAbove(current, base.p99Ns, curAbove99);
+    double tail95P = BinomialUpperTail(current.size(), curAbove95, baseRate95);
+    double tail99P = BinomialUpperTail(current.size(), curAbove99, baseRate99);
+
+    struct GateRow {
+        const char* name;
+        int64_t baseNs, curNs;
+        double pValue;
+    };
+    GateRow rows[] = {
+        {"P50", base.p50Ns, cur.p50Ns, locationP},
+        {"P95", base.p95Ns, cur.p95Ns, tail95P},
+        {"P99", base.p99Ns, cur.p99Ns, tail99P},
+    };
+
+    printf("\n %-5s %10s %10s %10s %10s %10s  %s\n", "", "Baseline", "Current", "Delta", "Tolerance", "p-value", "Verdict");
+    bool regression = false;
+    for (const GateRow& row : rows) {
+        double baseMs = row.baseNs / 1000000.0;
+        double curMs = row.curNs / 1000000.0;
+        double deltaMs = curMs - baseMs;
+        double toleranceMs = (std::max)(g_gateToleranceMs, baseMs * g_gateTolerancePct / 100.0);
+        bool significant = row.pValue < g_gateAlpha;
+        bool failed = significant && deltaMs > toleranceMs;
+        regression = regression || failed;
+        printf(" %-5s %10.2f %10.2f %+10.2f %10.2f %10.4f  %s\n", row.name, baseMs, curMs, deltaMs, toleranceMs,
+               row.pValue, failed ? "REGRESSION" : (deltaMs > toleranceMs ? "noise" : "ok"));
+    }
+
+    printf("\n Location shift (Mann-Whitney U, one-sided) : p = %.4f\n", locationP);
+    printf(" Above baseline P95 : %.1f%% -> %.1f%% (binomial, p = %.4f)\n", baseRate95 * 100.0, curRate95 * 100.0, tail95P);
+    printf(" Above baseline P99 : %.1f%% -> %.1f%% (binomial, p = %.4f)\n", baseRate99 * 100.0, curRate99 * 100.0, tail99P);
+
+    if (baselineNoChange >= 0) {
+        size_t baseAttempts = baseline.size() + static_cast<size_t>(baselineNoChange);
+        size_t curAttempts = current.size() + static_cast<size_t>(currentNoChange);
+        double baseRate = baselineNoChange / static_cast<double>(baseAttempts);
+        double curRate = currentNoChange / static_cast<double>(curAttempts);
+        // Référence sans aucun no-change : taux plancher d'un demi-échantillon, sinon le premier échouerait
+        double testRate = (std::max)(baseRate, 0.5 / baseAttempts);
+        double noChangeP = BinomialUpperTail(curAttempts, static_cast<size_t>(currentNoChange), testRate);
+        bool failed = noChangeP < g_gateAlpha && curRate > baseRate;
+        regression = regression || failed;
+        printf(" No change rate     : %.1f%% -> %.1f%% (binomial, p = %.4f)%s\n", baseRate * 100.0, curRate * 100.0,
+               noChangeP, failed ? "  REGRESSION" : "");
+    } else {
+        printf(" No change rate     : not recorded in the baseline, not compared\n");
+    }
+    printf(" Alpha %.3f, tolerance max(%.2f ms, %.1f%%)\n\n", g_gateAlpha, g_gateToleranceMs, g_gateTolerancePct);
+
+    if (regression) {
+        printf(" RESULT   : REGRESSION (exit code %d)\n\n", kGateExitRegression);
+        return kGateExitRegression;
+    }
+    printf(" RESULT   : PASS\n\n");
+    return 0;
+}
+
+// -------- Mode sweep (--sweep FILE) --------
+// Une cellule par ligne : "Nom de la cellule | n=210 nb-run=3 interval=50 dx=30 w=200 h=200".
+// Les clés absentes reprennent les valeurs de la ligne de commande. La progression est
+// ajoutée à FILE.progress après chaque cellule, ce qui permet de reprendre après un crash.
+struct SweepCell {
+    std::string name;
+    SessionConfig config;
+    int regionX = kRegionCentered, regionY = kRegionCentered, regionW = 0, regionH = 0;
+};
+
+struct SweepCellResult {
+    int index = 0;
+    std::string name;
+    LatencySummary latency;
+    double avgFps = 0.0;
+    int noChange = 0;
+};
+
+bool ParseSweepFile(const std::string& path, const SweepCell& defaults, std::vector<SweepCell>& cells) {
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "r") != 0 || !f) {
+        printf("[SWEEP] ERROR Could not open matrix file %s\n", path.c_str());
+        return false;
+    }
+
+    char line[512];
+    int lineNumber = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), f)) {
+        lineNumber++;
+        std::string text = TrimString(line);
+        if (text.empty() || text[0] == '#') continue;
+
+        SweepCell cell = defaults;
+        size_t bar = text.find('|');
+        cell.name = TrimString(text.substr(0, bar));
+        std::string params = bar == std::string::npos ? "" : text.substr(bar + 1);
+
+        size_t pos = 0;
+        while (pos < params.size()) {
+            size_t end = params.find_first_of(" \t", pos);
+            std::string token = params.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+            pos = end == std::string::npos ? params.size() : end + 1;
+            if (token.empty()) continue;
+
+            size_t eq = token.find('=');
+            if (eq == std::string::npos) {
+                printf("[SWEEP] ERROR %s:%d: expected key=value, got '%s'\n", path.c_str(), lineNumber, token.c_str());
+                ok = false;
+                continue;
+            }
+            std::string key = token.substr(0, eq);
+            int value = atoi(token.c_str() + eq + 1);
+            std::string stimulusError;
+            if (key == "stimulus") {
+                if (!ParseStimulusSequence(token.substr(eq + 1), cell.config.stimuli, stimulusError)) {
+                    printf("[SWEEP] ERROR %s:%d: %s\n", path.c_str(), lineNumber, stimulusError.c_str());
+                    ok = false;
+                }
+            }
+            else if (key == "n") cell.config.numSamples = value;
+            else if (key == "nb-run") cell.config.nbRun = value;
+            else if (key == "warmup") cell.config.warmupSamples = value;
+            else if (key == "interval") cell.config.intervalMs = value;
+            else if (key == "dx") cell.config.dx = value;
+            else if (key == "x") cell.regionX = value;
+            else if (key == "y") cell.regionY = value;
+            else if (key == "w") cell.regionW = value;
+            else if (key == "h") cell.regionH = value;
+            else {
+                printf("[SWEEP] ERROR %s:%d: unknown key '%s'\n", path.c_str(), lineNumber, key.c_str());
+                ok = false;
+            }
+        }
+
+        if (cell.name.empty() || cell.name.find('\t') != std::string::npos) {
+            printf("[SWEEP] ERROR %s:%d: cell needs a name without tabs\n", path.c_str(), lineNumber);
+            ok = false;
+        }
+        if (cell.config.numSamples < 1 || cell.config.nbRun < 1 || cell.config.intervalMs < 0) {
+            printf("[SWEEP] ERROR %s:%d: n and nb-run must be >= 1, interval >= 0\n", path.c_str(), lineNumber);
+            ok = false;
+        }
+        cells.push_back(cell);
+    }
+    fclose(f);
+
+    if (ok && cells.empty()) {
+        printf("[SWEEP] ERROR %s contains no cells\n", path.c_str());
+        ok = false;
+    }
+    return ok;
+}
+
+// Format : index<TAB>nom<TAB>samples<TAB>min<TAB>p50<TAB>avg<TAB>p95<TAB>p99<TAB>max<TAB>stddev<TAB>fps<TAB>nochange
+std::vector<SweepCellResult> LoadSweepProgress(const std::string& path) {
+    std::vector<SweepCellResult> done;
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "r") != 0 || !f) return done;
+
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        std::string text = TrimString(line);
+        size_t tab1 = text.find('\t');
+        size_t tab2 = tab1 == std::string::npos ? std::string::npos : text.find('\t', tab1 + 1);
+        if (tab2 == std::string::npos) continue;
+
+        SweepCellResult r;
+        r.index = atoi(text.c_str());
+        r.name = text.substr(tab1 + 1, tab2 - tab1 - 1);
+        long long samples = 0, minNs = 0, p50Ns = 0, avgNs = 0, p95Ns = 0, p99Ns = 0, maxNs = 0;
+        if (sscanf_s(text.c_str() + tab2 + 1, "%lld %lld %lld %lld %lld %lld %lld %lf %lf %d",
+                     &samples, &minNs, &p50Ns, &avgNs, &p95Ns, &p99Ns, &maxNs,
+                     &r.latency.stdDevNs, &r.avgFps, &r.noChange) != 10) {
+            continue;   // ligne tronquée par un crash
+        }
+        r.latency.samples = static_cast<size_t>(samples);
+        r.latency.minNs = minNs;
+        r.latency.p50Ns = p50Ns;
+        r.latency.avgNs = avgNs;
+        r.latency.p95Ns = p95Ns;
+        r.latency.p99Ns = p99Ns;
+        r.latency.maxNs = maxNs;
+        done.push_back(r);
+    }
+    fclose(f);
+    return done;
+}
+
+bool AppendSweepProgress(const std::string& path, const SweepCellResult& r) {
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "a") != 0 || !f) {
+        printf("[SWEEP] ERROR Could not update progress file %s\n", path.c_str());
+        return false;
+    }
+    fprintf(f, "%d\t%s\t%zu %lld %lld %lld %lld %lld %lld %.1f %.2f %d\n",
+            r.index, r.name.c_str(), r.latency.samples,
+            (long long)r.latency.minNs, (long long)r.latency.p50Ns, (long long)r.latency.avgNs,
+            (long long)r.latency.p95Ns, (long long)r.latency.p99Ns, (long long)r.latency.maxNs,
+            r.latency.stdDevNs, r.avgFps, r.noChange);
+    fflush(f);
+    fclose(f);
+    return true;
+}
+
+void PrintSweepTable(const std::vector<SweepCellResult>& results) {
+    double frameTimeMs = 1000.0 / g_monitorHz;
+    int64_t bestP50 = 0;
+    for (const auto& r : results) {
+        if (r.latency.samples > 0 && (bestP50 == 0 || r.latency.p50Ns < bestP50)) bestP50 = r.latency.p50Ns;
+    }
+
+    printf("\n");
+    printf("==========================================\n");
+    printf(" SWEEP COMPARISON (%zu cells)\n", results.size());
+    printf("==========================================\n\n");
+    printf(" %-3s %-32s %7s %8s %8s %8s %8s %8s %8s %7s %6s\n",
+           "#", "Cell", "Samples", "P50", "P50 fr", "P95", "P99", "StdDev", "P95-P50", "FPS", "NoChg");
+    for (const auto& r : results) {
+        const LatencySummary& l = r.latency;
+        if (l.samples == 0) {
+            printf(" %-3d %-32.32s %7d %8s %8s %8s %8s %8s %8s %7.1f %6d\n",
+                   r.index + 1, r.name.c_str(), 0, "-", "-", "-", "-", "-", "-", r.avgFps, r.noChange);
+            continue;
+        }
+        printf(" %-3d %-32.32s %7zu %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %7.1f %6d%s\n",
+               r.index + 1, r.name.c_str(), l.samples,
+               l.p50Ns / 1000000.0, (l.p50Ns / 1000000.0) / frameTimeMs,
+               l.p95Ns / 1000000.0, l.p99Ns / 1000000.0, l.stdDevNs / 1000000.0,
+               (l.p95Ns - l.p50Ns) / 1000000.0, r.avgFps, r.noChange,
+               l.p50Ns == bestP50 ? "  <- lowest P50" : "");
+    }
+    printf("\n Latencies in ms; P50 fr = P50 in frames at %d Hz.\n\n", g_monitorHz);
+}
+
+void WaitBeforeSweepCell(const SweepCell& cell, int index, int total) {
+    printf("\n###############################################\n");
+    printf(" SWEEP CELL %d / %d : %s\n", index + 1, total, cell.name.c_str());
+    printf(" n=%d nb-run=%d interval=%dms dx=%d\n",
+           cell.config.numSamples, cell.config.nbRun, cell.config.intervalMs, cell.config.dx);
+    printf("###############################################\n");
+
+    if (g_sweepWaitSeconds >= 0) {
+        printf("[SWEEP] Apply the game settings for this cell; starting in %d seconds...\n", g_sweepWaitSeconds);
+        for (int i = g_sweepWaitSeconds; i > 0; i--) {
+            printf(" %d...\n", i);
+            g_clock->sleepMs(1000);
+            if (g_showOverlay) {
+                ProcessWindowMessages();
+            }
+        }
+    } else {
+        printf("[SWEEP] Apply the game settings for this cell, then press ENTER...\n");
+        char buf[16];
+        if (!fgets(buf, sizeof(buf), stdin)) {
+            printf("[SWEEP] stdin closed, continuing\n");
+        }
+    }
+}
+
+// Exécute les cellules restantes en réutilisant les moteurs (device + duplication) existants
+void RunSweep(std::vector<std::unique_ptr<CaptureEngine>>& engines, const std::vector<SweepCell>& cells) {
+    std::string progressPath = g_sweepFilePath + ".progress";
+    std::vector<SweepCellResult> results;
+    size_t stale = 0;
+    for (const SweepCellResult& r : LoadSweepProgress(progressPath)) {
+        // Seules les entrées (index, nom) d'une cellule de la matrice actuelle comptent, une fois
+        bool current = r.index >= 0 && r.index < (int)cells.size() && cells[r.index].name == r.name;
+        for (const auto& kept : results) current = current && kept.index != r.index;
+        if (current) results.push_back(r);
+        else stale++;
+    }
+
+    if (stale > 0) {
+        printf("[SWEEP] Ignoring %zu progress entr%s that no longer match the matrix\n", stale, stale > 1 ? "ies" : "y");
+    }
+    if (!results.empty()) {
+        printf("[SWEEP] Resuming: %zu cell(s) already completed in %s\n", results.size(), progressPath.c_str());
+    }
+
+    CaptureEngine& primary = *engines.front();
+    for (size_t c = 0; c < cells.size(); c++) {
+        const SweepCell& cell = cells[c];
+        bool alreadyDone = false;
+        for (const auto& r : results) {
+            if (r.index == (int)c && r.name == cell.name) alreadyDone = true;
+        }
+        if (alreadyDone) {
+            printf("[SWEEP] Skipping completed cell %zu: %s\n", c + 1, cell.name.c_str());
+            continue;
+        }
+
+        WaitBeforeSweepCell(cell, static_cast<int>(c), static_cast<int>(cells.size()));
+
+        ApplyRegionToEngines(engines, cell.regionX, cell.regionY, cell.regionW, cell.regionH);
+
+        int noChangeBefore = primary.stats.exclusiveScreenDetected;
+        RunMeasurementSession(engines, cell.config);
+
+        std::vector<int64_t> latencies;
+        for (const auto& run : g_allResults) latencies.insert(latencies.end(), run.begin(), run.end());
+        std::vector<double> intervals;
+        for (const auto& run : g_allFrameIntervalsMs) intervals.insert(intervals.end(), run.begin(), run.end());
+
+        SweepCellResult r;
+        r.index = static_cast<int>(c);
+        r.name = cell.name;
+        r.latency = ComputeLatencySummary(latencies);
+        r.avgFps = ComputeFramePacingStats(intervals).avgFps;
+        r.noChange = primary.stats.exclusiveScreenDetected - noChangeBefore;
+        AppendSweepProgress(progressPath, r);
+        StoreSessionResults(g_storeTag.empty() ? cell.name : g_storeTag + "/" + cell.name);
+        results.push_back(r);
+
+        printf("[SWEEP] Cell %zu done: P50=%.2f ms P95=%.2f ms (%zu samples)\n", c + 1,
+               r.latency.p50Ns / 1000000.0, r.latency.p95Ns / 1000000.0, r.latency.samples);
+    }
+
+    std::sort(results.begin(), results.end(),
+              [](const SweepCellResult& a, const SweepCellResult& b) { return a.index < b.index; });
+    PrintSweepTable(results);
+    printf("[SWEEP] Progress kept in %s (delete it to start the matrix over)\n", progressPath.c_str());
+}
+
+// -------- Simulation du pipeline (--simulate FILE) --------
+// Une configuration par ligne : "Nom | fps=60,144,240 queue=1,2 sync=vsync,vrr,off compositor=0
+// hz=144 timer=1,15.6 poll=0.3 jitter=5 n=210 warmup=10 nb-run=3 interval=50 seed=1". Une liste
+// de valeurs séparées par des virgules donne le produit cartésien des configurations. Chacune
+// rejoue la boucle d'échantillonnage du moteur (CaptureEngine::runSample) sur sa VirtualClock ;
+// les configurations sont réparties sur tous les cœurs. Résultats détaillés dans FILE.results.
+struct PipelineSimCase {
+    PipelineSimConfig config;
+    std::vector<std::pair<std::string, std::string>> sweptKeys;   // clés à plusieurs valeurs
+    size_t samples = 0;
+    int noChange = 0;
+    double trueP50Ms = 0.0;
+    double measuredP50Ms = 0.0;
+    double biasMeanMs = 0.0;
+    double biasP5Ms = 0.0;
+    double biasP95Ms = 0.0;
+};
+
+static const char* PipelineSyncName(PipelineSync sync) {
+    switch (sync) {
+    case PipelineSync::Vsync: return "vsync";
+    case PipelineSync::Vrr: return "vrr";
+    case PipelineSync::Off: return "off";
+    }
+    return "?";
+}
+
+static bool SetPipelineSimKey(PipelineSimConfig& cfg, const std::string& key, const std::string& value) {
+    double v = std::atof(value.c_str());
+    if (key == "fps") cfg.gameFps = v;
+    else if (key == "queue") cfg.queueDepth = static_cast<int>(v);
+    else if (key == "sync") {
+        if (value == "vsync") cfg.sync = PipelineSync::Vsync;
+        else if (value == "vrr") cfg.sync = PipelineSync::Vrr;
+        else if (value == "off") cfg.sync = PipelineSync::Off;
+        else return false;
+    }
+    else if (key == "compositor") cfg.compositorMs = v;
+    else if (key == "hz") cfg.refreshHz = static_cast<int>(v);
+    else if (key == "timer") cfg.timerMs = v;
+    else if (key == "poll") cfg.pollCostMs = v;
+    else if (key == "jitter") cfg.jitterPct = v;
+    else if (key == "seed") cfg.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+    else if (key == "n") cfg.numSamples = static_cast<int>(v);
+    else if (key == "warmup") cfg.warmupSamples = static_cast<int>(v);
+    else if (key == "nb-run") cfg.nbRun = static_cast<int>(v);
+    else if (key == "interval") cfg.intervalMs = static_cast<int>(v);
+    else return false;
+
+    return cfg.gameFps > 0.0 && cfg.queueDepth >= 1 && cfg.queueDepth <= 8 && cfg.compositorMs >= 0.0 &&
+           cfg.refreshHz >= 1 && cfg.refreshHz <= 1000 && cfg.timerMs > 0.0 && cfg.pollCostMs >= 0.0 &&
+           cfg.jitterPct >= 0.0 && cfg.numSamples >= 1 && cfg.warmupSamples >= 0 && cfg.nbRun >= 1 &&
+           cfg.intervalMs >= 0;
+}
+
+bool ParsePipelineSimFile(const std::string& path, const PipelineSimConfig& defaults, std::vector<PipelineSimCase>& cases) {
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "r") != 0 || !f) {
+        printf("[SIM] ERROR Could not open configuration file %s\n", path.c_str());
+        return false;
+    }
+
+    char line[1024];
+    int lineNumber = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), f)) {
+        lineNumber++;
+        std::string text = TrimString(line);
+        if (text.empty() || text[0] == '#') continue;
+
+        size_t bar = text.find('|');
+        std::string name = TrimString(text.substr(0, bar));
+        std::string params = bar == std::string::npos ? "" : text.substr(bar + 1);
+        if (name.empty() || name.find('\t') != std::string::npos) {
+            printf("[SIM] ERROR %s:%d: configuration needs a name without tabs\n", path.c_str(), lineNumber);
+            ok = false;
+            continue;
+        }
+
+        const size_t kMaxCombinations = 1000000;
+        std::vector<std::pair<std::string, std::vector<std::string>>> keys;
+        size_t combinations = 1;
+        size_t pos = 0;
+        while (pos < params.size()) {
+            size_t end = params.find_first_of(" \t", pos);
+            std::string token = params.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+            pos = end == std::string::npos ? params.size() : end + 1;
+            if (token.empty()) continue;
+
+            size_t eq = token.find('=');
+            if (eq == std::string::npos) {
+                printf("[SIM] ERROR %s:%d: expected key=value, got '%s'\n", path.c_str(), lineNumber, token.c_str());
+                ok = false;
+                continue;
+            }
+            std::vector<std::string> values;
+            std::string list = token.substr(eq + 1);
+            for (size_t start = 0; start <= list.size();) {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos) comma = list.size();
+                values.push_back(list.substr(start, comma - start));
+                start = comma + 1;
+            }
+            // Saturé juste au-dessus de la limite : le produit des listes peut déborder size_t
+            combinations = combinations > kMaxCombinations / values.size() ? kMaxCombinations + 1
+                                                                          : combinations * values.size();
+            keys.push_back({token.substr(0, eq), values});
+        }
+        if (combinations > kMaxCombinations) {
+            printf("[SIM] ERROR %s:%d: more than %zu combinations\n", path.c_str(), lineNumber, kMaxCombinations);
+            ok = false;
+            continue;
+        }
+
+        // Indice en base mixte : la dernière clé varie le plus vite
+        for (size_t c = 0; c < combinations; c++) {
+            PipelineSimCase sc;
+            sc.config = defaults;
+            sc.config.name = name;
+            size_t rest = c;
+            for (size_t k = keys.size(); k-- > 0;) {
+                const std::vector<std::string>& values = keys[k].second;
+                const std::string& value = values[rest % values.size()];
+                rest /= values.size();
+                if (!SetPipelineSimKey(sc.config, keys[k].first, value)) {
+                    printf("[SIM] ERROR %s:%d: invalid %s=%s\n", path.c_str(), lineNumber, keys[k].first.c_str(), value.c_str());
+                    ok = false;
+                    break;
+                }
+                if (values.size() > 1) sc.sweptKeys.insert(sc.sweptKeys.begin(), {keys[k].first, value});
+            }
+            if (!ok) break;
+            for (const auto& kv : sc.sweptKeys) sc.config.name += " " + kv.first + "=" + kv.second;
+            cases.push_back(sc);
+        }
+    }
+    fclose(f);
+
+    if (ok && cases.empty()) {
+        printf("[SIM] ERROR %s contains no configuration\n", path.c_str());
+        ok = false;
+    }
+    return ok;
+}
+
+// Même enchaînement que RunMeasurementSession (input toutes les interval ms, attente par Sleep(1)),
+// sur le thread appelant ; seuls les échantillons hors warmup entrent dans les statistiques
+void RunPipelineSimCase(PipelineSimCase& sc) {
+    const PipelineSimConfig& cfg = sc.config;
+    VirtualClock clock(static_cast<int64_t>(cfg.timerMs * 1000000.0));
+    auto backend = std::make_unique<PipelineSimCapture>(cfg, clock);
+    PipelineSimCapture& sim = *backend;
+    CaptureEngine engine(0, std::move(backend), clock);
+    engine.init(0, 0, 0, 0, {});
+
+    std::vector<int64_t> trueNs, measuredNs, biasNs;
+    for (int runNumber = 1; runNumber <= cfg.nbRun; runNumber++) {
+        engine.prepareRun(runNumber, cfg.numSamples, cfg.warmupSamples);
+        engine.measureBaseline();
+        int64_t nextInputNs = clock.nowNs() + cfg.intervalMs * 1000000ll;
+        for (int s = 0; s < cfg.numSamples; s++) {
+            while (clock.nowNs() < nextInputNs) clock.sleepMs(1);
+            size_t input = sim.inputCount();
+            engine.measureSample(s, clock.nowNs(), -1);
+            const EngineSampleResult& result = engine.sampleResult();
+            if (s >= cfg.warmupSamples) {
+                int64_t truth = sim.trueLatencyNs(input);
+                if (!result.found) {
+                    sc.noChange++;
+                } else if (truth > 0) {
+                    trueNs.push_back(truth);
+                    measuredNs.push_back(result.latencyNs);
+                    biasNs.push_back(result.latencyNs - truth);
+                }
+            }
+            nextInputNs = clock.nowNs() + cfg.intervalMs * 1000000ll;
+        }
+        engine.endRun();
+    }
+
+    sc.samples = biasNs.size();
+    if (biasNs.empty()) return;
+    sc.trueP50Ms = ComputeLatencySummary(trueNs).p50Ns / 1000000.0;
+    sc.measuredP50Ms = ComputeLatencySummary(measuredNs).p50Ns / 1000000.0;
+    int64_t sum = 0;
+    for (int64_t b : biasNs) sum += b;
+    std::sort(biasNs.begin(), biasNs.end());
+    size_t n = biasNs.size();
+    sc.biasMeanMs = sum / static_cast<double>(n) / 1000000.0;
+    sc.biasP5Ms = SortedPercentile(biasNs, 0.05) / 1000000.0;
+    sc.biasP95Ms = SortedPercentile(biasNs, 0.95) / 1000000.0;
+}
+
+static void PrintPipelineSimRow(size_t index, const PipelineSimCase& sc) {
+    if (sc.samples == 0) {
+        printf(" %-5zu %-44.44s %7d %8s %8s %8s %8s %8s %6d\n", index + 1, sc.config.name.c_str(), 0,
+               "-", "-", "-", "-", "-", sc.noChange);
+        return;
+    }
+    printf(" %-5zu %-44.44s %7zu %8.2f %8.2f %+8.2f %+8.2f %+8.2f %6d\n", index + 1, sc.config.name.c_str(),
+           sc.samples, sc.trueP50Ms, sc.measuredP50Ms, sc.biasMeanMs, sc.biasP5Ms, sc.biasP95Ms, sc.noChange);
+}
+
+void PrintPipelineSimReport(const std::vector<PipelineSimCase>& cases) {
+    static const size_t kFullTableMax = 40;
+    static const size_t kWorstShown = 10;
+
+    printf("\n");
+    printf("==========================================\n");
+    printf(" ESTIMATOR BIAS (%zu simulated configurations)\n", cases.size());
+    printf("==========================================\n");
+    printf(" Bias = measured latency - true latency (present of the first frame that read the input)\n\n");
+
+    std::vector<size_t> order(cases.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    if (cases.size() > kFullTableMax) {
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return std::fabs(cases[a].biasMeanMs) > std::fabs(cases[b].biasMeanMs);
+        });
+        order.resize(kWorstShown);
+        printf(" Largest mean bias (full table in the .results file):\n");
+    }
+    printf(" %-5s %-44s %7s %8s %8s %8s %8s %8s %6s\n", "#", "Configuration", "Samples",
+           "True P50", "Meas P50", "Bias avg", "Bias P5", "Bias P95", "NoChg");
+    for (size_t i : order) PrintPipelineSimRow(i, cases[i]);
+
+    std::vector<double> means;
+    for (const auto& sc : cases) if (sc.samples > 0) means.push_back(sc.biasMeanMs);
+    if (means.empty()) return;
+    std::sort(means.begin(), means.end());
+    double total = 0.0;
+    for (double m : means) total += m;
+    printf("\n Mean bias over %zu configurations: %+.2f ms (P5 %+.2f, P95 %+.2f)\n", means.size(),
+           total / means.size(), SortedPercentile(means, 0.05), SortedPercentile(means, 0.95));
+
+    // Biais moyen par valeur de chaque paramètre balayé, dans l'ordre du fichier
+    struct ValueBias {
+        std::string value;
+        double sumMs;
+        int count;
+    };
+    std::vector<std::pair<std::string, std::vector<ValueBias>>> byKey;
+    for (const auto& sc : cases) {
+        if (sc.samples == 0) continue;
+        for (const auto& kv : sc.sweptKeys) {
+            auto key = std::find_if(byKey.begin(), byKey.end(), [&](const auto& k) { return k.first == kv.first; });
+            if (key == byKey.end()) key = byKey.insert(byKey.end(), {kv.first, {}});
+            auto value = std::find_if(key->second.begin(), key->second.end(),
+                                      [&](const ValueBias& v) { return v.value == kv.second; });
+            if (value == key->second.end()) value = key->second.insert(key->second.end(), {kv.second, 0.0, 0});
+            value->sumMs += sc.biasMeanMs;
+            value->count++;
+        }
+    }
+    for (const auto& key : byKey) {
+        printf(" By %s:", key.first.c_str());
+        for (const ValueBias& v : key.second) printf("  %s=%+.2f ms", v.value.c_str(), v.sumMs / v.count);
+        printf("\n");
+    }
+    printf("\n");
+}
+
+// Une ligne par configuration, séparateur tabulation
+bool WritePipelineSimResults(const std::string& path, const std::vector<PipelineSimCase>& cases) {
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "w") != 0 || !f) {
+        printf("[SIM] ERROR Could not write %s\n", path.c_str());
+        return false;
+    }
+    fprintf(f, "name\tfps\tqueue\tsync\tcompositor_ms\thz\ttimer_ms\tpoll_ms\tjitter_pct\tsamples\tno_change"
+               "\ttrue_p50_ms\tmeasured_p50_ms\tbias_avg_ms\tbias_p5_ms\tbias_p95_ms\n");
+    for (const auto& sc : cases) {
+        const PipelineSimConfig& c = sc.config;
+        fprintf(f, "%s\t%g\t%d\t%s\t%g\t%d\t%g\t%g\t%g\t%zu\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n",
+                c.name.c_str(), c.gameFps, c.queueDepth, PipelineSyncName(c.sync), c.compositorMs, c.refreshHz,
+                c.timerMs, c.pollCostMs, c.jitterPct, sc.samples, sc.noChange, sc.trueP50Ms, sc.measuredP50Ms,
+                sc.biasMeanMs, sc.biasP5Ms, sc.biasP95Ms);
+    }
+    fclose(f);
+    printf("[SIM] Results written to %s\n", path.c_str());
+    return true;
+}
+
+bool RunPipelineSimulation(const std::string& path, const PipelineSimConfig& defaults) {
+    std::vector<PipelineSimCase> cases;
+    if (!ParsePipelineSimFile(path, defaults, cases)) return false;
+
+    // Pas de dumps du flight recorder pour des sessions simulées
+    g_flightMaxDumps = 0;
+
+    size_t workers = (std::max)(1u, std::thread::hardware_concurrency());
+    workers = (std::min)(workers, cases.size());
+    printf("[SIM] %zu configuration(s) on %zu thread(s)\n", cases.size(), workers);
+
+    int64_t startNs = TraceNowNs();
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < workers; w++) {
+        threads.emplace_back([&] {
+            for (size_t i = next.fetch_add(1); i < cases.size(); i = next.fetch_add(1)) {
+                RunPipelineSimCase(cases[i]);
+                done.fetch_add(1);
+            }
+        });
+    }
+    size_t reported = 0;
+    while (reported < cases.size()) {
+        Sleep(200);
+        size_t d = done.load();
+        if (d != reported) {
+            printf("\r[SIM] %zu / %zu configurations", d, cases.size());
+            fflush(stdout);
+            reported = d;
+        }
+    }
+    for (auto& t : threads) t.join();
+    printf("\n[SIM] Done in %.1f s\n", (TraceNowNs() - startNs) / 1e9);
+
+    PrintPipelineSimReport(cases);
+    WritePipelineSimResults(path + ".results", cases);
+    return true;
+}
+
+// -------- Serveur de contrôle (--serve [NOM]) --------
+// Un orchestrateur pilote les sessions via le named pipe \\.\pipe\NOM : une commande texte par
+// ligne, réponses et événements en JSON lines. Les moteurs (device + duplication) restent
+// initialisés d'une session à l'autre ; délai de départ et pause valent 0 par défaut.
+//   configure n=200 warmup=10 interval=50 dx=30 runs=3 pause=0 delay=0 x=0 y=0 w=200 h=200 tag=NAME
+//   start | abort | status | shutdown
+static std::string JsonEscape(const std::string& str) {
+    std::string out;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8] = {};
+            sprintf_s(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+class ControlServer : public SessionObserver {
+public:
+    // Région de départ = celle de la ligne de commande, avec laquelle les moteurs ont été créés
+    ControlServer(std::vector<std::unique_ptr<CaptureEngine>>& engines, const SessionConfig& defaults,
+                  int regionX, int regionY, int regionW, int regionH)
+        : engines_(engines), config_(defaults), regionX_(regionX), regionY_(regionY), regionW_(regionW), regionH_(regionH) {
+        config_.startDelayMs = 0;
+        config_.pauseSeconds = 0;
+        config_.observer = this;
+    }
+
+    // Sert les clients l'un après l'autre jusqu'à la commande shutdown
+    int run(const std::string& name) {
+        std::string path = "\\\\.\\pipe\\" + name;
+        while (!shutdown_.load()) {
+            pipe_ = CreateNamedPipeA(path.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                                     PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 64 * 1024, 4096, 0, nullptr);
+            if (pipe_ == INVALID_HANDLE_VALUE) {
+                printf("[SERVE] ERROR CreateNamedPipe(%s) failed: %lu\n", path.c_str(), GetLastError());
+                return 1;
+            }
+            printf("[SERVE] Waiting for a client on %s\n", path.c_str());
+            if (!waitForClient()) {
+                CloseHandle(pipe_);
+                return 1;
+            }
+
+            printf("[SERVE] Client connected\n");
+            connected_.store(true);
+            reader_ = std::thread(&ControlServer::readerMain, this);
+            sendHello();
+
+            while (connected_.load() && !shutdown_.load()) {
+                std::string command;
+                if (!popCommand(command)) continue;
+                if (command == "start") runSession();
+            }
+
+            g_abortRequested.store(true);
+            CancelIoEx(pipe_, nullptr);
+            reader_.join();
+            {
+                // Un start resté en file appartenait au client parti : le suivant repart de zéro
+                std::lock_guard<std::mutex> lock(commandMutex_);
+                commands_.clear();
+                sessionRunning_.store(false);
+            }
+            DisconnectNamedPipe(pipe_);
+            CloseHandle(pipe_);
+            pipe_ = INVALID_HANDLE_VALUE;
+            printf("[SERVE] Client disconnected\n");
+        }
+        printf("[SERVE] Shutdown requested\n");
+        return 0;
+    }
+
+    void onRunStart(int runNumber, int totalRuns) override {
+        currentRun_.store(runNumber);
+        currentSample_.store(0);
+        char line[128] = {};
+        sprintf_s(line, sizeof(line), "{\"event\":\"run_start\",\"run\":%d,\"runs\":%d}", runNumber, totalRuns);
+        sendLine(line);
+    }
+
+    void onSample(int runNumber, int sampleCount, const std::vector<std::unique_ptr<CaptureEngine>>& engines) override {
+        currentSample_.store(sampleCount);
+        std::string json;
+        char buf[128] = {};
+        sprintf_s(buf, sizeof(buf), "{\"event\":\"sample\",\"run\":%d,\"sample\":%d,\"outputs\":[", runNumber, sampleCount);
+        json = buf;
+        for (size_t e = 0; e < engines.size(); e++) {
+            const EngineSampleResult& r = engines[e]->sampleResult();
+            if (r.found) {
+                sprintf_s(buf, sizeof(buf), "%s{\"output\":%d,\"found\":true,\"latency_ms\":%.3f}",
+                          e ? "," : "", engines[e]->index(), r.latencyNs / 1000000.0);
+            } else {
+                sprintf_s(buf, sizeof(buf), "%s{\"output\":%d,\"found\":false}", e ? "," : "", engines[e]->index());
+            }
+            json += buf;
+        }
+        json += "]}";
+        sendLine(json);
+    }
+
+    void onRunEnd(int runNumber, const std::vector<int64_t>& latencies) override {
+        LatencySummary l = ComputeLatencySummary(latencies);
+        char line[256] = {};
+        sprintf_s(line, sizeof(line),
+                  "{\"event\":\"run_end\",\"run\":%d,\"samples\":%zu,\"p50_ms\":%.3f,\"p95_ms\":%.3f,\"p99_ms\":%.3f}",
+                  runNumber, l.samples, l.p50Ns / 1000000.0, l.p95Ns / 1000000.0, l.p99Ns / 1000000.0);
+        sendLine(line);
+    }
+
+private:
+    bool waitForClient() {
+        OVERLAPPED ov = {};
+        ov.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        bool ok = false;
+        if (ConnectNamedPipe(pipe_, &ov)) {
+            ok = true;
+        } else {
+            DWORD err = GetLastError();
+            if (err == ERROR_PIPE_CONNECTED) {
+                ok = true;
+            } else if (err == ERROR_IO_PENDING) {
+                DWORD ignored = 0;
+                ok = GetOverlappedResult(pipe_, &ov, &ignored, TRUE) != 0;
+            }
+        }
+        if (!ok) printf("[SERVE] ERROR ConnectNamedPipe failed: %lu\n", GetLastError());
+        CloseHandle(ov.hEvent);
+        return ok;
+    }
+
+    // Les lectures et les écritures se font sur des threads différents : handle en mode overlapped
+    void sendLine(const std::string& json) {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        if (!connected_.load()) return;
+        std::string data = json + "\n";
+        OVERLAPPED ov = {};
+        ov.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        DWORD written = 0;
+        if (!WriteFile(pipe_, data.data(), static_cast<DWORD>(data.size()), &written, &ov) &&
+            (GetLastError() != ERROR_IO_PENDING || !GetOverlappedResult(pipe_, &ov, &written, TRUE))) {
+            connected_.store(false);
+            commandCv_.notify_all();
+        }
+        CloseHandle(ov.hEvent);
+    }
+
+    void sendError(const std::string& message) {
+        sendLine("{\"event\":\"error\",\"message\":\"" + JsonEscape(message) + "\"}");
+    }
+
+    void sendHello() {
+        const CaptureEngine& primary = *engines_.front();
+        char line[384] = {};
+        sprintf_s(line, sizeof(line),
+                  "{\"event\":\"hello\",\"version\":1,\"outputs\":%zu,\"gpu\":\"%s\",\"monitor\":\"%s\",\"hz\":%d}",
+                  engines_.size(), JsonEscape(primary.capture->gpuName()).c_str(),
+                  JsonEscape(primary.capture->monitorName()).c_str(), primary.capture->refreshRateHz);
+        sendLine(line);
+    }
+
+    void sendStatus() {
+        char line[192] = {};
+        sprintf_s(line, sizeof(line),
+                  "{\"event\":\"status\",\"state\":\"%s\",\"run\":%d,\"runs\":%d,\"sample\":%d,\"samples\":%d}",
+                  sessionRunning_.load() ? "running" : "idle", currentRun_.load(), config_.nbRun,
+                  currentSample_.load(), config_.numSamples);
+        sendLine(line);
+    }
+
+    void readerMain() {
+        OVERLAPPED ov = {};
+        ov.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        std::string pending;
+        char buffer[1024];
+        while (connected_.load()) {
+            DWORD bytesRead = 0;
+            if (!ReadFile(pipe_, buffer, sizeof(buffer), &bytesRead, &ov) &&
+                (GetLastError() != ERROR_IO_PENDING || !GetOverlappedResult(pipe_, &ov, &bytesRead, TRUE))) {
+                break;
+            }
+            if (bytesRead == 0) continue;
+            pending.append(buffer, bytesRead);
+            size_t eol;
+            while ((eol = pending.find('\n')) != std::string::npos) {
+                std::string line = TrimString(pending.substr(0, eol));
+                pending.erase(0, eol + 1);
+                if (!line.empty()) handleLine(line);
+            }
+        }
+        CloseHandle(ov.hEvent);
+        connected_.store(false);
+        if (sessionRunning_.load()) {
+            g_abortRequested.store(true);   // l'orchestrateur a disparu : inutile de continuer
+        }
+        commandCv_.notify_all();
+    }
+
+    // Thread de lecture : status et abort sont traités immédiatement, le reste passe par la file
+    void handleLine(const std::string& line) {
+        size_t space = line.find(' ');
+        std::string verb = line.substr(0, space);
+        std::string args = space == std::string::npos ? "" : line.substr(space + 1);
+
+        if (verb == "status") {
+            sendStatus();
+        } else if (verb == "abort") {
+            if (!sessionRunning_.load()) {
+                sendError("no session running");
+                return;
+            }
+            g_abortRequested.store(true);
+            sendLine("{\"event\":\"aborting\"}");
+        } else if (verb == "shutdown") {
+            shutdown_.store(true);
+            g_abortRequested.store(true);
+            sendLine("{\"event\":\"shutdown\"}");
+            commandCv_.notify_all();
+        } else if (verb == "configure") {
+            if (sessionRunning_.load()) {
+                sendError("session running, abort it first");
+                return;
+            }
+            std::string error;
+            if (!configure(args, error)) sendError(error);
+        } else if (verb == "start") {
+            if (sessionRunning_.load()) {
+                sendError("session already running");
+                return;
+            }
+            std::lock_guard<std::mutex> lock(commandMutex_);
+            // Remis à zéro ici et non dans runSession : une déconnexion juste après le start
+            // doit encore pouvoir interrompre la session
+            g_abortRequested.store(false);
+            sessionRunning_.store(true);
+            commands_.push_back(verb);
+            commandCv_.notify_all();
+        } else {
+            sendError("unknown command: " + verb);
+        }
+    }
+
+    bool configure(const std::string& args, std::string& error) {
+        SessionConfig next = config_;
+        int x = regionX_, y = regionY_, w = regionW_, h = regionH_;
+        std::string tag = tag_;
+        size_t pos = 0;
+        while (pos < args.size()) {
+            size_t end = args.find(' ', pos);
+            std::string token = args.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+            pos = end == std::string::npos ? args.size() : end + 1;
+            if (token.empty()) continue;
+            size_t eq = token.find('=');
+            if (eq == std::string::npos) {
+                error = "expected key=value, got " + token;
+                return false;
+            }
+            std::string key = token.substr(0, eq);
+            std::string text = token.substr(eq + 1);
+            int value = atoi(text.c_str());
+            if (key == "n") next.numSamples = value;
+            else if (key == "warmup") next.warmupSamples = value;
+            else if (key == "interval") next.intervalMs = value;
+            else if (key == "dx") next.dx = value;
+            else if (key == "runs") next.nbRun = value;
+            else if (key == "pause") next.pauseSeconds = value;
+            else if (key == "delay") next.startDelayMs = value;
+            else if (key == "x") x = value;
+            else if (key == "y") y = value;
+            else if (key == "w") w = value;
+            else if (key == "h") h = value;
+            else if (key == "tag") tag = text;
+            else if (key == "stimulus") {
+                if (!ParseStimulusSequence(text, next.stimuli, error)) return false;
+            }
+            else {
+                error = "unknown key: " + key;
+                return false;
+            }
+        }
+        if (next.numSamples < 1 || next.nbRun < 1 || next.intervalMs < 0 || next.pauseSeconds < 0 || next.startDelayMs < 0) {
+            error = "n and runs must be >= 1, interval, pause and delay >= 0";
+            return false;
+        }
+
+        config_ = next;
+        tag_ = tag;
+        if (x != regionX_ || y != regionY_ || w != regionW_ || h != regionH_) {
+            regionX_ = x;
+            regionY_ = y;
+            regionW_ = w;
+            regionH_ = h;
+            ApplyRegionToEngines(engines_, x, y, w, h);
+        }
+
+        char line[256] = {};
+        sprintf_s(line, sizeof(line),
+                  "{\"event\":\"configured\",\"n\":%d,\"warmup\":%d,\"interval\":%d,\"dx\":%d,\"runs\":%d,\"pause\":%d,\"delay\":%d}",
+                  config_.numSamples, config_.warmupSamples, config_.intervalMs, config_.dx, config_.nbRun,
+                  config_.pauseSeconds, config_.startDelayMs);
+        sendLine(line);
+        return true;
+    }
+
+    bool popCommand(std::string& command) {
+        std::unique_lock<std::mutex> lock(commandMutex_);
+        commandCv_.wait_for(lock, std::chrono::milliseconds(50), [this] {
+            return !commands_.empty() || !connected_.load() || shutdown_.load();
+        });
+        if (g_showOverlay) {
+            ProcessWindowMessages();
+        }
+        if (commands_.empty() || !connected_.load()) return false;
+        command = commands_.front();
+        commands_.erase(commands_.begin());
+        return true;
+    }
+
+    void runSession() {
+        currentRun_.store(0);
+        currentSample_.store(0);
+        sendLine("{\"event\":\"session_start\"}");
+
+        // Les stats moteur cumulent toutes les sessions du serveur : on ne rapporte que l'écart
+        int noChangeBefore = 0;
+        for (const auto& engine : engines_) noChangeBefore += engine->stats.exclusiveScreenDetected;
+
+        bool completed = RunMeasurementSession(engines_, config_);
+
+        std::vector<int64_t> latencies;
+        for (const auto& runResults : g_allResults) latencies.insert(latencies.end(), runResults.begin(), runResults.end());
+        LatencySummary l = ComputeLatencySummary(latencies);
+        int noChange = -noChangeBefore;
+        for (const auto& engine : engines_) noChange += engine->stats.exclusiveScreenDetected;
+
+        char line[384] = {};
+        sprintf_s(line, sizeof(line),
+                  "{\"event\":\"session_end\",\"aborted\":%s,\"samples\":%zu,\"min_ms\":%.3f,\"p50_ms\":%.3f,"
+                  "\"avg_ms\":%.3f,\"p95_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f,\"stddev_ms\":%.3f,\"no_change_total\":%d}",
+                  completed ? "false" : "true", l.samples, l.minNs / 1000000.0, l.p50Ns / 1000000.0,
+                  l.avgNs / 1000000.0, l.p95Ns / 1000000.0, l.p99Ns / 1000000.0, l.maxNs / 1000000.0,
+                  l.stdDevNs / 1000000.0, noChange);
+        if (completed) StoreSessionResults(tag_);
+        sessionRunning_.store(false);
+        sendLine(line);
+    }
+
+    std::vector<std::unique_ptr<CaptureEngine>>& engines_;
+    SessionConfig config_;
+    int regionX_, regionY_, regionW_, regionH_;
+    std::string tag_;
+
+    HANDLE pipe_ = INVALID_HANDLE_VALUE;
+    std::thread reader_;
+    std::mutex writeMutex_;
+    std::mutex commandMutex_;
+    std::condition_variable commandCv_;
+    std::vector<std::string> commands_;
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> shutdown_{false};
+    std::atomic<bool> sessionRunning_{false};
+    std::atomic<int> currentRun_{0};
+    std::atomic<int> currentSample_{0};
+};
+
+// -------- Endpoint Prometheus (--metrics PORT) --------
+// Serveur HTTP minimal sur 127.0.0.1, thread de basse priorité, une requête à la fois.
+// GET /metrics renvoie les compteurs des moteurs au format texte Prometheus 0.0.4.
+static std::string PrometheusLabel(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        if (c == '\\' || c == '"') out += '\\';
+        if (c == '\n') {
+            out += "\\n";
+            continue;
+        }
+        out += c;
+    }
+    return out;
+}
+
+class MetricsServer {
+public:
+    explicit MetricsServer(const std::vector<std::unique_ptr<CaptureEngine>>& engines) : engines_(engines) {}
+    ~MetricsServer() { stop(); }
+
+    // Réserve le port avant l'initialisation des moteurs : une erreur de port échoue tout de suite
+    bool bindPort(int port) {
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+            printf("[METRICS] ERROR WSAStartup failed\n");
+            return false;
+        }
+        wsaStarted_ = true;
+
+        listenSocket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<unsigned short>(port));
+        if (listenSocket_ == INVALID_SOCKET ||
+            bind(listenSocket_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR ||
+            listen(listenSocket_, 4) == SOCKET_ERROR) {
+            printf("[METRICS] ERROR Could not listen on 127.0.0.1:%d\n", port);
+            stop();
+            return false;
+        }
+        port_ = port;
+        return true;
+    }
+
+    // Démarre le thread HTTP une fois les moteurs créés
+    void start() {
+        if (listenSocket_ == INVALID_SOCKET || thread_.joinable()) return;
+        thread_ = std::thread(&MetricsServer::serve, this);
+        printf("[METRICS] Serving http://127.0.0.1:%d/metrics\n", port_);
+    }
+
+    void stop() {
+        if (listenSocket_ != INVALID_SOCKET) {
+            closesocket(listenSocket_);   // débloque accept()
+            listenSocket_ = INVALID_SOCKET;
+        }
+        if (thread_.joinable()) thread_.join();
+        if (wsaStarted_) {
+            WSACleanup();
+            wsaStarted_ = false;
+        }
+    }
+
+private:
+    void serve() {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+        for (;;) {
+            SOCKET client = accept(listenSocket_, nullptr, nullptr);
+            if (client == INVALID_SOCKET) break;
+            DWORD timeoutMs = kMetricsRecvTimeoutMs;
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeoutMs), sizeof(timeoutMs));
+
+            char request[2048];
+            int received = 0;
+            while (received < (int)sizeof(request) - 1) {
+                int n = recv(client, request + received, static_cast<int>(sizeof(request)) - 1 - received, 0);
+                if (n <= 0) break;
+                received += n;
+                request[received] = 0;
+                if (strstr(request, "\r\n\r\n")) break;
+            }
+            request[received] = 0;
+
+            std::string response;
+            if (strncmp(request, "GET /metrics", 12) == 0) {
+                std::string body = render();
+                char header[160] = {};
+                sprintf_s(header, sizeof(header),
+                          "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: %zu\r\nConnection: close\r\n\r\n", body.size());
+                response = header + body;
+            } else {
+                response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            }
+            send(client, response.data(), static_cast<int>(response.size()), 0);
+            closesocket(client);
+        }
+    }
+
+    void writeCounterFamily(std::string& out, const char* name, const char* help,
+                            std::atomic<uint64_t> EngineMetrics::*counter) const {
+        char line[256] = {};
+        sprintf_s(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+        out += line;
+        for (const auto& engine : engines_) {
+            sprintf_s(line, sizeof(line), "%s{output=\"%d\"} %llu\n", name, engine->index(),
+                      (unsigned long long)(engine->metrics.*counter).load(std::memory_order_relaxed));
+            out += line;
+        }
+    }
+
+    std::string render() {
+        std::string out;
+        out.reserve(16 * 1024);
+        char line[384] = {};
+
+        out += "# HELP inputlag_info Captured output (value is always 1).\n# TYPE inputlag_info gauge\n";
+        for (const auto& engine : engines_) {
+            sprintf_s(line, sizeof(line), "inputlag_info{output=\"%d\",gpu=\"%s\",monitor=\"%s\",refresh_hz=\"%d\"} 1\n",
+                      engine->index(), PrometheusLabel(engine->capture->gpuName()).c_str(),
+                      PrometheusLabel(engine->capture->monitorName()).c_str(), engine->capture->refreshRateHz);
+            out += line;
+        }
+
+        out += "# HELP inputlag_latency_seconds Input to screen change latency (after warmup).\n"
+               "# TYPE inputlag_latency_seconds histogram\n";
+        for (const auto& engine : engines_) {
+            sprintf_s(line, sizeof(line), "output=\"%d\"", engine->index());
+            engine->metrics.latency.write(out, "inputlag_latency_seconds", line);
+        }
+
+        out += "# HELP inputlag_frame_interval_seconds Time between presented frames (frame pacing).\n"
+               "# TYPE inputlag_frame_interval_seconds histogram\n";
+        for (const auto& engine : engines_) {
+            sprintf_s(line, sizeof(line), "output=\"%d\"", engine->index());
+            engine->metrics.frameInterval.write(out, "inputlag_frame_interval_seconds", line);
+        }
+
+        writeCounterFamily(out, "inputlag_samples_total", "Latency samples recorded.", &EngineMetrics::samples);
+        writeCounterFamily(out, "inputlag_no_change_total", "Samples without a detected screen change.", &EngineMetrics::noChange);
+        writeCounterFamily(out, "inputlag_acquire_timeouts_total", "AcquireNextFrame timeouts.", &EngineMetrics::acquireTimeouts);
+        writeCounterFamily(out, "inputlag_acquire_errors_total", "AcquireNextFrame failures other than timeouts.", &EngineMetrics::acquireErrors);
+        writeCounterFamily(out, "inputlag_polls_total", "Capture attempts.", &EngineMetrics::polls);
+        writeCounterFamily(out, "inputlag_presented_frames_total", "Frames presented on the output.", &EngineMetrics::presentedFrames);
+
+        return out;
+    }
+
+    const std::vector<std::unique_ptr<CaptureEngine>>& engines_;
+    SOCKET listenSocket_ = INVALID_SOCKET;
+    bool wsaStarted_ = false;
+    int port_ = 0;
+    std::thread thread_;
+};
+
+// -------- Tableau de bord terminal (--dashboard) --------
+// Rendu ANSI sur un thread de priorité minimale, kDashboardRefreshMs entre deux images, à
+// partir d'un instantané des EngineMetrics : les moteurs n'ont rien de plus à faire. Les
+// premières lignes de la console sont réservées (zone de défilement DECSTBM), le journal
+// habituel continue de défiler en dessous. Chaque image part en un seul fwrite pour ne pas
+// s'entrelacer avec les printf du thread principal.
+class TerminalDashboard {
+public:
+    explicit TerminalDashboard(const std::vector<std::unique_ptr<CaptureEngine>>& engines) : engines_(engines) {}
+    ~TerminalDashboard() { stop(); }
+
+    bool start() {
+        HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD mode = 0;
+        if (!GetConsoleMode(out, &mode) || !SetConsoleMode(out, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING)) {
+            printf("[DASHBOARD] Output is not an ANSI-capable console, dashboard disabled\n");
+            return false;
+        }
+        consoleRows_ = ConsoleRows();
+        if (consoleRows_ < height() + 5) {
+            printf("[DASHBOARD] Console too small (%d rows, need %d), dashboard disabled\n",
+                   consoleRows_, height() + 5);
+            return false;
+        }
+
+        char init[64] = {};
+        sprintf_s(init, sizeof(init), "\x1b[2J\x1b[%d;%dr\x1b[%d;1H", height() + 1, consoleRows_, height() + 1);
+        fputs(init, stdout);
+        fflush(stdout);
+
+        lastPolls_.assign(engines_.size(), 0);
+        lastFrames_.assign(engines_.size(), 0);
+        lastTick_ = GetTickCount64();
+        running_ = true;
+        thread_ = std::thread(&TerminalDashboard::threadMain, this);
+        return true;
+    }
+
+    // Dernière image, puis libère la zone réservée et replace le curseur en bas
+    void stop() {
+        if (!thread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_one();
+        thread_.join();
+
+        std::string frame = render();
+        char reset[32] = {};
+        sprintf_s(reset, sizeof(reset), "\x1b[r\x1b[%d;1H\n", consoleRows_);
+        frame += reset;
+        fwrite(frame.data(), 1, frame.size(), stdout);
+        fflush(stdout);
+    }
+
+private:
+    static const int kSparklineBins = 40;
+
+    int height() const { return 2 + 3 * static_cast<int>(engines_.size()); }
+
+    static int ConsoleRows() {
+        CONSOLE_SCREEN_BUFFER_INFO info = {};
+        if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) return 0;
+        return info.srWindow.Bottom - info.srWindow.Top + 1;
+    }
+
+    void threadMain() {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_) {
+            lock.unlock();
+            std::string frame = render();
+            fwrite(frame.data(), 1, frame.size(), stdout);
+            fflush(stdout);
+            lock.lock();
+            cv_.wait_for(lock, milliseconds(kDashboardRefreshMs), [this] { return !running_; });
+        }
+    }
+
+    // Ligne `row` (1-based) effacée puis réécrite
+    static void AppendLine(std::string& frame, int row, const char* text) {
+        char position[24] = {};
+        sprintf_s(position, sizeof(position), "\x1b[%d;1H\x1b[2K", row);
+        frame += position;
+        frame += text;
+    }
+
+    // Instantané d'un moteur -> trois lignes : percentiles, sparkline, taux d'erreur
+    void renderEngine(std::string& frame, int row, size_t e, double elapsedSec) {
+        const EngineMetrics& m = engines_[e]->metrics;
+        uint64_t samples = m.samples.load(std::memory_order_acquire);
+        uint64_t polls = m.polls.load(std::memory_order_relaxed);
+        uint64_t noChange = m.noChange.load(std::memory_order_relaxed);
+        uint64_t timeouts = m.acquireTimeouts.load(std::memory_order_relaxed);
+        uint64_t errors = m.acquireErrors.load(std::memory_order_relaxed);
+        uint64_t frames = m.presentedFrames.load(std::memory_order_relaxed);
+
+        size_t n = static_cast<size_t>(std::min<uint64_t>(samples, EngineMetrics::kRecentSamples));
+        std::vector<double> recentMs(n);
+        for (size_t i = 0; i < n; i++) {
+            size_t slot = static_cast<size_t>((samples - n + i) % EngineMetrics::kRecentSamples);
+            recentMs[i] = m.recentLatencyUs[slot].load(std::memory_order_relaxed) / 1000.0;
+        }
+        std::sort(recentMs.begin(), recentMs.end());
+
+        char line[512] = {};
+        if (n == 0) {
+            sprintf_s(line, sizeof(line), " OUT%d  waiting for samples...", engines_[e]->index());
+            AppendLine(frame, row, line);
+            AppendLine(frame, row + 1, "");
+        } else {
+            auto at = [&](double q) { return SortedPercentile(recentMs, q); };
+            double lo = recentMs.front(), hi = recentMs.back();
+            sprintf_s(line, sizeof(line),
+                      " OUT%d  P50 \x1b[1m%6.2f\x1b[0m  P95 %6.2f  P99 %6.2f  min %6.2f  max %6.2f ms  (last %zu)",
+                      engines_[e]->index(), at(0.50), at(0.95), at(0.99), lo, hi, n);
+            AppendLine(frame, row, line);
+
+            // Histogramme des latences récentes entre min et max
+            int bins[kSparklineBins] = {};
+            int peak = 0;
+            for (double v : recentMs) {
+                int b = hi > lo ? static_cast<int>((v - lo) / (hi - lo) * kSparklineBins) : 0;
+                if (b >= kSparklineBins) b = kSparklineBins - 1;
+                peak = std::max(peak, ++bins[b]);
+            }
+            static const char* kLevels[] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+            std::string spark = "       |";
+            for (int b = 0; b < kSparklineBins; b++) {
+                spark += bins[b] == 0 ? " " : kLevels[(bins[b] * 8 - 1) / peak];
+            }
+            sprintf_s(line, sizeof(line), "| %.2f .. %.2f ms", lo, hi);
+            spark += line;
+            AppendLine(frame, row + 1, spark.c_str());
+        }
+
+        double missPct = (samples + noChange) > 0 ? 100.0 * noChange / (samples + noChange) : 0.0;
+        double timeoutPct = polls > 0 ? 100.0 * timeouts / polls : 0.0;
+        double pollRate = elapsedSec > 0.0 ? (polls - lastPolls_[e]) / elapsedSec : 0.0;
+        double fps = elapsedSec > 0.0 ? (frames - lastFrames_[e]) / elapsedSec : 0.0;
+        const char* missColor = noChange > 0 ? "\x1b[31m" : "";
+        const char* errorColor = errors > 0 ? "\x1b[31m" : "";
+        sprintf_s(line, sizeof(line),
+                  "       %sno-change %.1f%%\x1b[0m  timeouts %.1f%% of polls  %serrors %llu\x1b[0m  polls/s %.0f  fps %.1f",
+                  missColor, missPct, timeoutPct, errorColor, (unsigned long long)errors, pollRate, fps);
+        AppendLine(frame, row + 2, line);
+
+        lastPolls_[e] = polls;
+        lastFrames_[e] = frames;
+    }
+
+    std::string render() {
+        ULONGLONG now = GetTickCount64();
+        double elapsedSec = (now - lastTick_) / 1000.0;
+        lastTick_ = now;
+
+        std::string frame = "\x1b" "7";   // DECSC : sauvegarde du curseur du journal
+        int rows = ConsoleRows();
+        if (rows > height() + 5 && rows != consoleRows_) {
+            consoleRows_ = rows;
+            char region[32] = {};
+            sprintf_s(region, sizeof(region), "\x1b[%d;%dr", height() + 1, consoleRows_);
+            frame += region;
+        }
+
+        const EngineMetrics& primary = engines_.front()->metrics;
+        char line[256] = {};
+        sprintf_s(line, sizeof(line), "\x1b[7m inputlag-tester | RUN %d | sample %d/%d | %zu output(s) \x1b[0m",
+                  primary.run.load(std::memory_order_relaxed), primary.runSample.load(std::memory_order_relaxed),
+                  primary.runSamples.load(std::memory_order_relaxed), engines_.size());
+        AppendLine(frame, 1, line);
+
+        for (size_t e = 0; e < engines_.size(); e++) {
+            renderEngine(frame, 2 + 3 * static_cast<int>(e), e, elapsedSec);
+        }
+        AppendLine(frame, height(), "\x1b[2m--------------------------------------------------------------------------------\x1b[0m");
+        frame += "\x1b" "8";   // DECRC
+        return frame;
+    }
+
+    const std::vector<std::unique_ptr<CaptureEngine>>& engines_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool running_ = false;
+    int consoleRows_ = 0;
+    ULONGLONG lastTick_ = 0;
+    std::vector<uint64_t> lastPolls_;
+    std::vector<uint64_t> lastFrames_;
+};
+
+// -------- Benchmark des chemins chauds (--benchmark FILE) --------
+// Débit du noyau de détection de changement, des statistiques, de la sérialisation des
+// résultats et de la boucle d'échantillonnage complète, en 1080p, 1440p et 4K pour des régions
+// de 50x50 à l'écran entier. Chaque cas est répété par lots doublés jusqu'à kBenchmarkMinNs ;
+// le JSON produit (un objet par cas) permet de suivre les régressions d'un commit à l'autre.
+static const int64_t kBenchmarkMinNs = 200000000;
+static const int kBenchmarkRoiSizes[] = {50, 200, 500, 1000, 0};   // 0 : écran entier
+static const size_t kBenchmarkSampleCounts[] = {1000, 10000, 100000};
+
+// Compteur d'allocations (colonne allocs/op) : il remplace l'opérateur new global de tout le
+// programme, il n'est donc compilé qu'avec /DINPUTLAG_COUNT_ALLOCS=1 (build de benchmark).
+#ifndef INPUTLAG_COUNT_ALLOCS
+#define INPUTLAG_COUNT_ALLOCS 0
+#endif
+
+static volatile uint64_t g_benchmarkSink = 0;
+
+#if INPUTLAG_COUNT_ALLOCS
+static std::atomic<uint64_t> g_allocCount{0};
+
+void* operator new(size_t size) {
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static uint64_t BenchmarkAllocCount() { return g_allocCount.load(std::memory_order_relaxed); }
+#else
+static uint64_t BenchmarkAllocCount() { return 0; }
+#endif
+
+struct BenchmarkResult {
+    std::string group;    // kernel | stats | serialize | loop
+    std::string name;
+    std::string config;
+    const char* unit = "";
+    uint64_t iterations = 0;
+    double nsPerOp = 0.0;
+    double nsPerUnit = 0.0;
+    double pollsPerSecond = 0.0;   // kernel : un hachage par sondage ; loop : sondages effectués
+    double allocsPerOp = -1.0;     // < 0 : non mesuré (build sans INPUTLAG_COUNT_ALLOCS)
+};
+
+// op() exécute une opération et retourne le nombre d'unités traitées (pixels, échantillons, sondages)
+template <typename Op>
+BenchmarkResult MeasureBenchmark(const char* group, const char* name, const std::string& config,
+                                 const char* unit, Op&& op) {
+    op();   // échauffement : caches, tampons et allocations du premier appel
+    BenchmarkResult r;
+    r.group = group;
+    r.name = name;
+    r.config = config;
+    r.unit = unit;
+    uint64_t allocs = 0;
+    double units = 0.0;
+    int64_t elapsedNs = 0;
+    for (uint64_t batch = 1; elapsedNs < kBenchmarkMinNs; batch *= 2) {
+        uint64_t allocStart = BenchmarkAllocCount();
+        int64_t startNs = TraceNowNs();
+        for (uint64_t i = 0; i < batch; i++) units += static_cast<double>(op());
+        elapsedNs += TraceNowNs() - startNs;
+        allocs += BenchmarkAllocCount() - allocStart;
+        r.iterations += batch;
+    }
+    r.nsPerOp = static_cast<double>(elapsedNs) / r.iterations;
+    r.nsPerUnit = units > 0.0 ? elapsedNs / units : 0.0;
+#if INPUTLAG_COUNT_ALLOCS
+    r.allocsPerOp = static_cast<double>(allocs) / r.iterations;
+#else
+    (void)allocs;
+#endif
+    return r;
+}
+
+// Image BGRA aléatoire ; pitch aligné sur 256 octets comme le RowPitch d'une texture de staging
+struct BenchmarkFrame {
+    int width = 0;
+    int height = 0;
+    int pitch = 0;
+    std::vector<uint8_t> pixels;
+};
+
+static BenchmarkFrame MakeBenchmarkFrame(int width, int height) {
+    BenchmarkFrame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.pitch = (width * 4 + 255) / 256 * 256;
+    frame.pixels.resize(static_cast<size_t>(frame.pitch) * height);
+    std::mt19937 rng(static_cast<uint32_t>(width * 31 + height));
+    for (size_t i = 0; i + 4 <= frame.pixels.size(); i += 4) {
+        uint32_t v = rng();
+        memcpy(&frame.pixels[i], &v, sizeof(v));
+    }
+    return frame;
+}
+
+// Région principale centrée de côté size (0 : écran entier), comme l'auto-région de DXGICapture
+static void BenchmarkRegion(const BenchmarkFrame& frame, int size, int& x, int& y, int& w, int& h) {
+    w = size == 0 ? frame.width : (std::min)(size, frame.width);
+    h = size == 0 ? frame.height : (std::min)(size, frame.height);
+    x = (frame.width - w) / 2;
+    y = (frame.height - h) / 2;
+}
+
+// Source synthétique qui hache en plus l'image de test à chaque capture réussie, comme
+// DXGICapture après Map : la boucle mesurée inclut le noyau de détection (sans copie GPU)
+class BenchmarkCapture : public SyntheticCapture {
+public:
+    BenchmarkCapture(const SyntheticCaptureConfig& config, Clock& clock, const BenchmarkFrame& frame)
+        : SyntheticCapture(config, clock), frame_(frame) {}
+
+    HRESULT init(int regionX, int regionY, int regionW, int regionH,
+                 const std::vector<CaptureRoi>& extraRois, int adapterIndex, int outputIndex) override {
+        HRESULT hr = SyntheticCapture::init(regionX, regionY, regionW, regionH, extraRois, adapterIndex, outputIndex);
+        screenW_ = frame_.width;
+        screenH_ = frame_.height;
+        return hr;
+    }
+
+    void setRegion(int regionX, int regionY, int regionW, int regionH) override {
+        plan_.build(regionX, regionY, regionW, regionH, {}, frame_.width, frame_.height);
+    }
+
+    HRESULT captureFrame(CaptureFrameInfo& info) override {
+        HRESULT hr = SyntheticCapture::captureFrame(info);
+        if (SUCCEEDED(hr)) {
+            uint32_t hashes[kCaptureTileCount + kMaxExtraRois];
+            plan_.hash(frame_.pixels.data(), frame_.pitch, hashes);
+            uint32_t checksum = 0;
+            for (int t = 0; t < kCaptureTileCount; t++) checksum ^= hashes[t];
+            g_benchmarkSink += checksum;
+        }
+        return hr;
+    }
+
+private:
+    const BenchmarkFrame& frame_;
+    RegionHashPlan plan_;
+};
+
+static void PrintBenchmarkRow(const BenchmarkResult& r) {
+    char polls[32] = "-";
+    if (r.pollsPerSecond > 0.0) sprintf_s(polls, sizeof(polls), "%.0f", r.pollsPerSecond);
+    char allocs[32] = "-";
+    if (r.allocsPerOp >= 0.0) sprintf_s(allocs, sizeof(allocs), "%.2f", r.allocsPerOp);
+    printf(" %-9s %-15s %-32s %12.0f %10.3f %-6s %12s %9s\n", r.group.c_str(), r.name.c_str(),
+           r.config.c_str(), r.nsPerOp, r.nsPerUnit, r.unit, polls, allocs);
+    fflush(stdout);
+}
+
+static void BenchmarkKernels(std::vector<BenchmarkResult>& results, const std::vector<BenchmarkFrame>& frames) {
+    for (const BenchmarkFrame& frame : frames) {
+        for (int size : kBenchmarkRoiSizes) {
+            int x, y, w, h;
+            BenchmarkRegion(frame, size, x, y, w, h);
+            RegionHashPlan plan;
+            plan.build(x, y, w, h, {}, frame.width, frame.height);
+            uint32_t previous = 0;
+            char config[64] = {};
+            sprintf_s(config, sizeof(config), "%dx%d roi=%dx%d", frame.width, frame.height, w, h);
+            BenchmarkResult r = MeasureBenchmark("kernel", "region-hash", config, "pixel", [&]() {
+                uint32_t hashes[kCaptureTileCount + kMaxExtraRois];
+                plan.hash(frame.pixels.data(), frame.pitch, hashes);
+                uint32_t checksum = 0;
+                for (int t = 0; t < kCaptureTileCount; t++) checksum ^= hashes[t];
+                g_benchmarkSink += checksum != previous;
+                previous = checksum;
+                return static_cast<size_t>(w) * h;
+            });
+            r.pollsPerSecond = r.nsPerOp > 0.0 ? 1e9 / r.nsPerOp : 0.0;
+            PrintBenchmarkRow(r);
+            results.push_back(r);
+        }
+    }
+}
+
+// Latences bimodales (deux paquets à une frame de 144 Hz d'écart), comme sous V-Sync
+static std::vector<int64_t> MakeBenchmarkLatencies(size_t n, uint32_t seed, double shiftMs) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> early(10.6 + shiftMs, 0.5), late(17.8 + shiftMs, 0.5);
+    std::uniform_real_distribution<double> pick(0.0, 1.0);
+    std::vector<int64_t> out(n);
+    for (size_t i = 0; i < n; i++) {
+        double ms = pick(rng) < 0.3 ? early(rng) : late(rng);
+        out[i] = static_cast<int64_t>((std::max)(ms, 0.1) * 1000000.0);
+    }
+    return out;
+}
+
+static void BenchmarkStatistics(std::vector<BenchmarkResult>& results) {
+    for (size_t n : kBenchmarkSampleCounts) {
+        std::vector<int64_t> current = MakeBenchmarkLatencies(n, 1, 0.0);
+        std::vector<int64_t> baseline = MakeBenchmarkLatencies(n, 2, 0.2);
+        std::vector<double> intervalsMs(n);
+        for (size_t i = 0; i < n; i++) intervalsMs[i] = 6.94 + (current[i] % 1000) / 1000.0;
+        char config[64] = {};
+        sprintf_s(config, sizeof(config), "n=%zu", n);
+
+        std::vector<BenchmarkResult> cases;
+        cases.push_back(MeasureBenchmark("stats", "summary", config, "sample", [&]() {
+            g_benchmarkSink += ComputeLatencySummary(current).p50Ns;
+            return n;
+        }));
+        cases.push_back(MeasureBenchmark("stats", "kde-modes", config, "sample", [&]() {
+            g_benchmarkSink += ComputeLatencyDensity(current, 1000.0 / 144).modes.size();
+            return n;
+        }));
+        cases.push_back(MeasureBenchmark("stats", "ks-drift", config, "sample", [&]() {
+            double statistic = 0.0;
+            g_benchmarkSink += KolmogorovSmirnovPValue(baseline, current, statistic) < g_gateAlpha;
+            return 2 * n;
+        }));
+        cases.push_back(MeasureBenchmark("stats", "mann-whitney", config, "sample", [&]() {
+            g_benchmarkSink += MannWhitneyGreaterPValue(current, baseline) < g_gateAlpha;
+            return 2 * n;
+        }));
+        cases.push_back(MeasureBenchmark("stats", "frame-pacing", config, "frame", [&]() {
+            g_benchmarkSink += ComputeFramePacingStats(intervalsMs).stutters;
+            return n;
+        }));
+        for (const BenchmarkResult& r : cases) {
+            PrintBenchmarkRow(r);
+            results.push_back(r);
+        }
+    }
+}
+
+// Sérialisation des résultats : fichier de baseline (--save-baseline / --baseline)
+static bool BenchmarkSerialization(std::vector<BenchmarkResult>& results) {
+    char tempDir[MAX_PATH] = {};
+    GetTempPathA(MAX_PATH, tempDir);
+    std::string path = std::string(tempDir) + "inputlag-benchmark-baseline.txt";
+
+    for (size_t n : kBenchmarkSampleCounts) {
+        std::vector<int64_t> latencies = MakeBenchmarkLatencies(n, 3, 0.0);
+        char config[64] = {};
+        sprintf_s(config, sizeof(config), "n=%zu", n);
+        bool ok = true;
+        BenchmarkResult write = MeasureBenchmark("serialize", "baseline-write", config, "sample", [&]() {
+            ok = WriteBaselineFile(path, latencies, 0) && ok;
+            return n;
+        });
+        std::vector<int64_t> loaded;
+        std::string description;
+        int loadedNoChange = 0;
+        BenchmarkResult read = MeasureBenchmark("serialize", "baseline-read", config, "sample", [&]() {
+            loaded.clear();
+            ok = LoadBaselineFile(path, loaded, description, loadedNoChange) && ok;
+            return loaded.size();
+        });
+        if (!ok || loaded.size() != n) {
+            printf("[BENCH] ERROR Baseline round trip failed in %s\n", path.c_str());
+            remove(path.c_str());
+            return false;
+        }
+        PrintBenchmarkRow(write);
+        PrintBenchmarkRow(read);
+        results.push_back(write);
+        results.push_back(read);
+    }
+    remove(path.c_str());
+    return true;
+}
+
+// Boucle d'échantillonnage complète sur horloge virtuelle : une opération = un run de
+// numSamples échantillons (prepareRun, référence, sondage jusqu'au changement, endRun)
+static void BenchmarkSamplingLoop(std::vector<BenchmarkResult>& results, const std::vector<BenchmarkFrame>& frames) {
+    const int numSamples = 210;
+    const int warmupSamples = 10;
+    const int intervalMs = 50;
+    for (const BenchmarkFrame& frame : frames) {
+        SyntheticCaptureConfig synth;
+        synth.enabled = true;
+        synth.seed = 1;
+        VirtualClock clock(1000000);
+        CaptureEngine engine(0, std::make_unique<BenchmarkCapture>(synth, clock, frame), clock);
+        int x, y, w, h;
+        BenchmarkRegion(frame, kBenchmarkRoiSizes[0], x, y, w, h);
+        engine.init(x, y, w, h, {});
+
+        for (int size : kBenchmarkRoiSizes) {
+            BenchmarkRegion(frame, size, x, y, w, h);
+            engine.capture->setRegion(x, y, w, h);
+            char config[64] = {};
+            sprintf_s(config, sizeof(config), "%dx%d roi=%dx%d n=%d", frame.width, frame.height, w, h, numSamples);
+            BenchmarkResult r = MeasureBenchmark("loop", "synthetic-run", config, "poll", [&]() {
+                uint64_t before = engine.metrics.polls.load(std::memory_order_relaxed);
+                engine.resetResults();
+                engine.prepareRun(1, numSamples, warmupSamples);
+                engine.measureBaseline();
+                int64_t nextInputNs = clock.nowNs() + intervalMs * 1000000ll;
+                for (int s = 0; s < numSamples; s++) {
+                    while (clock.nowNs() < nextInputNs) clock.sleepMs(1);
+                    engine.measureSample(s, clock.nowNs(), -1);
+                    nextInputNs = clock.nowNs() + intervalMs * 1000000ll;
+                }
+                engine.endRun();
+                return static_cast<size_t>(engine.metrics.polls.load(std::memory_order_relaxed) - before);
+            });
+            r.pollsPerSecond = r.nsPerUnit > 0.0 ? 1e9 / r.nsPerUnit : 0.0;   // 0 : aucun sondage
+            PrintBenchmarkRow(r);
+            results.push_back(r);
+        }
+    }
+}
+
+static std::string BenchmarkCompiler() {
+    char buf[64] = {};
+#if defined(_MSC_VER)
+    sprintf_s(buf, sizeof(buf), "msvc %d", _MSC_VER);
+#elif defined(__clang__)
+    sprintf_s(buf, sizeof(buf), "clang %d.%d.%d", __clang_major__, __clang_minor__, __clang_patchlevel__);
+#elif defined(__GNUC__)
+    sprintf_s(buf, sizeof(buf), "gcc %d.%d.%d", __GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__);
+#else
+    sprintf_s(buf, sizeof(buf), "unknown");
+#endif
+    return buf;
+}
+
+bool WriteBenchmarkResults(const std::string& path, const std::vector<BenchmarkResult>& results) {
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "w") != 0 || !f) {
+        printf("[BENCH] ERROR Could not write %s\n", path.c_str());
+        return false;
+    }
+    fprintf(f, "{\n  \"tool\": \"inputlag-tester\",\n  \"timestamp\": %lld,\n",
+            static_cast<long long>(time(nullptr)));
+    fprintf(f, "  \"compiler\": \"%s\",\n  \"cpu\": \"%s\",\n  \"min_ns_per_case\": %lld,\n  \"results\": [\n",
+            JsonEscape(BenchmarkCompiler()).c_str(), JsonEscape(GetCpuName()).c_str(),
+            static_cast<long long>(kBenchmarkMinNs));
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& r = results[i];
+        char allocs[32] = "null";   // JSON null : non mesuré
+        if (r.allocsPerOp >= 0.0) sprintf_s(allocs, sizeof(allocs), "%.3f", r.allocsPerOp);
+        fprintf(f, "    {\"group\": \"%s\", \"name\": \"%s\", \"config\": \"%s\", \"iterations\": %llu, "
+                   "\"ns_per_op\": %.1f, \"unit\": \"%s\", \"ns_per_unit\": %.4f, \"polls_per_s\": %.1f, "
+                   "\"allocs_per_op\": %s}%s\n",
+                r.group.c_str(), r.name.c_str(), r.config.c_str(), static_cast<unsigned long long>(r.iterations),
+                r.nsPerOp, r.unit, r.nsPerUnit, r.pollsPerSecond, allocs,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    printf("[BENCH] Results written: %s (%zu cases)\n", path.c_str(), results.size());
+    return true;
+}
+
+bool RunBenchmarks(const std::string& path) {
+    // Pas de dumps du flight recorder pour les runs synthétiques du benchmark
+    g_flightMaxDumps = 0;
+
+    std::vector<BenchmarkFrame> frames;
+    frames.push_back(MakeBenchmarkFrame(1920, 1080));
+    frames.push_back(MakeBenchmarkFrame(2560, 1440));
+    frames.push_back(MakeBenchmarkFrame(3840, 2160));
+
+    printf("\n==========================================================================================================\n");
+    printf(" BENCHMARK (each case repeated for at least %lld ms)\n", static_cast<long long>(kBenchmarkMinNs / 1000000));
+    printf("==========================================================================================================\n");
+    printf(" %-9s %-15s %-32s %12s %10s %-6s %12s %9s\n", "Group", "Case", "Config", "ns/op", "ns/unit", "unit",
+           "polls/s", "allocs/op");
+
+    int64_t startNs = TraceNowNs();
+    std::vector<BenchmarkResult> results;
+    BenchmarkKernels(results, frames);
+    BenchmarkStatistics(results);
+    if (!BenchmarkSerialization(results)) return false;
+    BenchmarkSamplingLoop(results, frames);
+    printf("==========================================================================================================\n");
+    printf("[BENCH] Done in %.1f s\n", (TraceNowNs() - startNs) / 1e9);
+    return WriteBenchmarkResults(path, results);
+}
+
+// ==================== Main ====================
+int main(int argc, char** argv) {
+    int64_t processStartNs = TraceNowNs();
+    SetConsoleCP(CP_UTF8);
+    SetConsoleOutputCP(CP_UTF8);
+
+    printf("\n========================================\n");
+    printf(" inputlag-tester with Overlay\n");
+    printf(" (Timeout: %d ms)\n", g_maxWaitMs);
+    printf("========================================\n\n");
+
+    if (!ParseCommandLineArgs(argc, argv)) {
+        return 1;
+    }
+
+    if (g_listOutputs) {
+        ListOutputs();
+        return 0;
+    }
+
+    if (g_showHistory) {
+        if (g_storeDir.empty()) {
+            printf("[ERROR] --history needs a results store (--store DIR)\n");
+            return 1;
+        }
+        int adapterIndex = g_outputSelections.empty() ? -1 : g_outputSelections.front().adapterIndex;
+        PrintResultsHistory(GetAdapterName(adapterIndex), g_storeTag);
+        return 0;
+    }
+
+    int regionX = kRegionCentered, regionY = kRegionCentered, regionW = 0, regionH = 0;
+    int numSamples = 210;
+    int warmupSamples = 10;
+    int intervalMs = 50;
+    int dx = 30;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-x" && i + 1 < argc) regionX = atoi(argv[++i]);
+        else if (arg == "-y" && i + 1 < argc) regionY = atoi(argv[++i]);
+        else if (arg == "-w" && i + 1 < argc) regionW = atoi(argv[++i]);
+        else if (arg == "-h" && i + 1 < argc) regionH = atoi(argv[++i]);
+        else if (arg == "-n" && i + 1 < argc) numSamples = atoi(argv[++i]);
+        else if (arg == "-warmup" && i + 1 < argc) warmupSamples = atoi(argv[++i]);
+        else if (arg == "-interval" && i + 1 < argc) intervalMs = atoi(argv[++i]);
+        else if (arg == "-dx" && i + 1 < argc) dx = atoi(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc) g_outputFilePath = argv[++i];
+    }
+
+    std::vector<Stimulus> stimuli;
+    if (!g_stimulusSpec.empty()) {
+        std::string error;
+        if (!ParseStimulusSequence(g_stimulusSpec, stimuli, error)) {
+            printf("[ERROR] --stimulus: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    if (!g_benchmarkFilePath.empty()) {
+        return RunBenchmarks(g_benchmarkFilePath) ? 0 : 1;
+    }
+
+    if (!g_simulateFilePath.empty()) {
+        PipelineSimConfig defaults;
+        defaults.numSamples = numSamples;
+        defaults.warmupSamples = warmupSamples;
+        defaults.intervalMs = intervalMs;
+        defaults.nbRun = g_nbRun;
+        return RunPipelineSimulation(g_simulateFilePath, defaults) ? 0 : 1;
+    }
+
+    if (!g_clock->realTime()) {
+        if (!g_synthetic.enabled) {
+            printf("[ERROR] --virtual-clock needs --synthetic (DXGI capture runs in real time)\n");
+            return 1;
+        }
+        if (g_outputSelections.size() > 1) {
+            printf("[ERROR] --virtual-clock measures a single output\n");
+            return 1;
+        }
+    }
+
+    std::vector<int64_t> baselineLatencies;
+    std::string baselineDescription;
+    int baselineNoChange = -1;
+    if (!g_baselinePath.empty() || !g_saveBaselinePath.empty()) {
+        if (!g_sweepFilePath.empty()) {
+            printf("[ERROR] --baseline / --save-baseline cannot be combined with --sweep\n");
+            return 1;
+        }
+        if (!g_servePipeName.empty()) {
+            printf("[ERROR] --baseline / --save-baseline cannot be combined with --serve\n");
+            return 1;
+        }
+        if (!g_baselinePath.empty() && !LoadBaselineFile(g_baselinePath, baselineLatencies, baselineDescription, baselineNoChange)) {
+            return 1;
+        }
+    }
+    if (!g_servePipeName.empty() && !g_sweepFilePath.empty()) {
+        printf("[ERROR] --serve cannot be combined with --sweep\n");
+        return 1;
+    }
+
+    SessionConfig session;
+    session.numSamples = numSamples;
+    session.warmupSamples = warmupSamples;
+    session.intervalMs = intervalMs;
+    session.dx = dx;
+    session.nbRun = g_nbRun;
+    session.pauseSeconds = g_pauseSeconds;
+    session.stimuli = stimuli;
+
+    // Matrice lue avant l'initialisation des moteurs : une erreur de syntaxe échoue tout de suite
+    std::vector<SweepCell> sweepCells;
+    if (!g_sweepFilePath.empty()) {
+        SweepCell defaults;
+        defaults.config = session;
+        defaults.regionX = regionX;
+        defaults.regionY = regionY;
+        defaults.regionW = regionW;
+        defaults.regionH = regionH;
+        if (!ParseSweepFile(g_sweepFilePath, defaults, sweepCells)) {
+            return 1;
+        }
+    }
+
+    printf("Config: dx=%d interval=%dms n=%d warmup=%d timeout=%dms\n\n", 
+           dx, intervalMs, numSamples, warmupSamples, g_maxWaitMs);
+
+    if (g_outputSelections.empty()) {
+        g_outputSelections.push_back(OutputSelection());
+    }
+
+    std::vector<std::unique_ptr<CaptureEngine>> engines;
+    // Déclaré après les moteurs : arrêté avant leur destruction
+    MetricsServer metricsServer(engines);
+    if (g_metricsPort > 0 && !metricsServer.bindPort(g_metricsPort)) {
+        return 1;
+    }
+
+    // Inventaire matériel en parallèle de l'initialisation des moteurs
+    std::future<HardwareInventory> inventory = std::async(std::launch::async, LoadOrCollectHardwareInventory,
+                                                          g_outputSelections.front().adapterIndex);
+
+    for (size_t e = 0; e < g_outputSelections.size(); e++) {
+        const OutputSelection& sel = g_outputSelections[e];
+        if (g_outputSelections.size() > 1) {
+            printf("[OUTPUT %zu] Adapter %d, output %d\n", e, sel.adapterIndex < 0 ? 0 : sel.adapterIndex, sel.outputIndex);
+        }
+        auto engine = std::make_unique<CaptureEngine>(static_cast<int>(e), sel);
+        HRESULT hr = engine->init(regionX, regionY, regionW, regionH, g_extraRois);
+        if (FAILED(hr)) {
+            printf("[ERROR] Capture init failed: 0x%X\n", hr);
+            return 1;
+        }
+        engines.push_back(std::move(engine));
+    }
+
+    ApplyHardwareInventory(inventory.get());
+
+    CaptureEngine& primary = *engines.front();
+    g_gpuName = primary.capture->gpuName();
+    g_gpuVram = primary.capture->gpuVram();
+    g_monitorName = primary.capture->monitorName();
+    g_monitorHz = primary.capture->refreshRateHz;
+
+    double frameTimeMs = primary.frameTimeMs();
+    g_overlayFrameTimeMs = frameTimeMs;
+    for (const auto& engine : engines) {
+        printf("Monitor: %s %dHz (%.2f ms per frame)\n", engine->capture->monitorName().c_str(),
+               engine->capture->refreshRateHz, engine->frameTimeMs());
+    }
+    printf("\n");
+
+    // Créer l'overlay si activé
+    if (g_showOverlay) {
+        CreateOverlayWindow();
+    }
+
+    printf("\n========================================\n");
+    printf(" STARTING MULTI-RUN TEST\n");
+    printf(" Runs  : %d\n", g_nbRun);
+    printf(" Pause : %d seconds\n", g_pauseSeconds);
+    if (engines.size() > 1) {
+        printf(" Outputs: %zu (captured concurrently)\n", engines.size());
+    }
+    if (g_diagnostic) {
+        printf(" Mode  : DIAGNOSTIC ENABLED\n");
+    }
+    if (g_showOverlay) {
+        printf(" Overlay: ENABLED (top-right corner, scale: %.2f)\n", g_overlaySizeFactor);
+    }
+    printf("========================================\n\n");
+
+    if (g_traceEnabled) {
+        g_traceOriginNs = TraceNowNs();
+        TraceRegisterCurrentThread("input");
+    }
+
+    ApplyProcessScheduling();
+    ApplyThreadScheduling(g_inputScheduling, "input", 0);
+    for (auto& engine : engines) {
+        engine->start();
+    }
+    printf("[OK] Ready to measure %.1f ms after startup\n", (TraceNowNs() - processStartNs) / 1000000.0);
+
+    metricsServer.start();
+    TerminalDashboard dashboard(engines);
+    if (g_showDashboard) {
+        dashboard.start();
+    }
+
+    if (!g_servePipeName.empty()) {
+        ControlServer server(engines, session, regionX, regionY, regionW, regionH);
+        int serverCode = server.run(g_servePipeName);
+        dashboard.stop();
+        for (auto& engine : engines) {
+            engine->shutdown();
+        }
+        if (g_traceEnabled) {
+            WriteChromeTrace(g_traceFilePath);
+        }
+        RevertThreadScheduling(g_inputScheduling);
+        RestoreProcessScheduling();
+        return serverCode;
+    }
+
+    if (!g_sweepFilePath.empty()) {
+        RunSweep(engines, sweepCells);
+    } else {
+        RunMeasurementSession(engines, session);
+        StoreSessionResults(g_storeTag);
+    }
+    dashboard.stop();
+
+    for (auto& engine : engines) {
+        engine->shutdown();
+        AccumulateDiagnosticStats(g_diagStats, engine->stats);
+    }
+    RevertThreadScheduling(g_inputScheduling);
+    RestoreProcessScheduling();
+    if (!g_sweepFilePath.empty()) {
+        // Les résultats globaux ne contiennent que la dernière cellule : seul le tableau compte
+        printf("\n[SWEEP] Per-cell results are in the comparison table above\n");
+    } else {
+        printf("\n\n========================================\n");
+        printf(" ALL RUNS COMPLETED\n");
+        printf("========================================\n");
+
+        PrintAverageResults();
+        PrintStimulusBreakdown(frameTimeMs);
+        PrintOutputComparison(engines);
+        PrintLatencyDecomposition(engines);
+    }
+    PrintDiagnosticStats();
+    PrintTraceReport();
+    PrintSchedulingReport(engines);
+    if (g_flightDumpsTotal.load() > 0) {
+        printf("[FLIGHT] %d flight recorder dump(s) written\n", g_flightDumpsTotal.load());
+    }
+    if (g_traceEnabled) {
+        WriteChromeTrace(g_traceFilePath);
+    }
+
+    int exitCode = 0;
+    if (!g_baselinePath.empty() || !g_saveBaselinePath.empty()) {
+        std::vector<int64_t> latencies;
+        for (const auto& run : g_allResults) latencies.insert(latencies.end(), run.begin(), run.end());
+        // Sortie principale seulement, comme les latences (g_allResults)
+        int noChange = primary.stats.exclusiveScreenDetected;
+        if (!g_saveBaselinePath.empty() && !SaveBaselineFile(g_saveBaselinePath, latencies, noChange)) {
+            exitCode = 1;
+        }
+        if (!g_baselinePath.empty()) {
+            int gateCode = RunRegressionGate(baselineLatencies, baselineNoChange, baselineDescription, latencies, noChange);
+            if (gateCode != 0) exitCode = gateCode;
+        }
+    }
+
+    // Laisser la fenêtre affichée 5 secondes avant de fermer
+    if (g_overlayWindow) {
+        printf("\n[OVERLAY] Closing in 5 seconds...\n");
+        for (int i = 5; i > 0; i--) {
+            Sleep(1000);
+            ProcessWindowMessages();
+        }
+        DestroyOverlayWindow();
+    }
+
+    printf("\n[+] Test completed successfully\n\n");
+
+    return exitCode;
 }